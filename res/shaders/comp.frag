@@ -0,0 +1,34 @@
+#version 330 core
+
+out vec4 frag_color;
+
+in vec2 px;
+
+uniform usampler2DArray ids;
+uniform sampler2DArray tex;
+uniform sampler1D pal;
+uniform ivec2 tm_scroll;
+uniform ivec2 wm_scroll;
+
+uint tile_at(ivec2 p, int layer)
+{
+	return texelFetch(ids, ivec3((p >> 3) & 31, layer), 0).r;
+}
+
+void main()
+{
+	ivec2 p = ivec2(px);
+	ivec2 q = p + wm_scroll;
+	int layer = 1;
+	uint id = tile_at(q, layer);
+
+	if (id == 0u) {
+		q = p + tm_scroll;
+		layer = 0;
+		id = tile_at(q, layer);
+	}
+
+	ivec2 t = ivec2(id & 15u, id >> 4u) * 8 + (q & 7);
+	float i = texelFetch(tex, ivec3(t, layer), 0).r;
+	frag_color = texture(pal, i);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+
+out vec2 px;
+
+void main()
+{
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+	gl_Position = vec4(corner * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0, 1);
+	px = corner * vec2(160.0, 144.0);
+}
@@ -0,0 +1,30 @@
+#version 330 core
+
+out vec4 frag_color;
+
+in vec2 px;
+
+uniform usampler2D qm;
+uniform usampler2D quads;
+uniform sampler2D tex;
+uniform sampler1D pal;
+uniform ivec2 cam;
+uniform ivec2 size;
+uniform uint def_quad;
+
+void main()
+{
+	ivec2 p = ivec2(px) + cam;
+	ivec2 q = p >> 4;
+	ivec2 s = (p >> 3) & 1;
+	uint d = def_quad;
+
+	if (all(greaterThanEqual(q, ivec2(0))) && all(lessThan(q, size))) {
+		d = texelFetch(qm, q, 0).r;
+	}
+
+	uint id = texelFetch(quads, ivec2(d, s.y * 2 + s.x), 0).r;
+	ivec2 t = ivec2(id & 15u, id >> 4u) * 8 + (p & 7);
+	float i = texelFetch(tex, t, 0).r;
+	frag_color = texture(pal, i);
+}
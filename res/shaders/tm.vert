@@ -12,7 +12,11 @@ out VS_OUT {
 void main()
 {
 	vec2 t = vec2(gl_VertexID, gl_VertexID >> 5);
+#ifdef SCROLL
 	vec2 p = mod(t - scroll, 32) - 1.0;
+#else
+	vec2 p = mod(t, 32);
+#endif
 	gl_Position = vec4(p, 0, 1);
 	vs_out.id = id;
 }
@@ -0,0 +1,30 @@
+#version 330 core
+
+uniform mat4 projection;
+uniform vec2 scroll; 
+uniform usamplerBuffer tiles;
+
+out vec2 tex_coord;
+
+void main()
+{
+#ifdef SCROLL
+	vec2 s = scroll + 1.0;
+#else
+	vec2 s = vec2(0.0);
+#endif
+	vec2 cell = vec2(gl_InstanceID % 21, gl_InstanceID / 21);
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	ivec2 t = ivec2(mod(floor(s) + cell, 32.0));
+
+	uint id = texelFetch(tiles, t.y * 32 + t.x).r & 255u;
+	vec2 tile = vec2(id & 15u, id >> 4u) / 16.0; 
+
+	vec2 pos = cell - fract(s) + corner;
+
+	gl_Position = projection * vec4(pos, 0.0, 1.0);
+#ifdef CULL
+	gl_Position *= float(id != 0u);
+#endif
+	tex_coord = tile + corner / 16.0;
+}
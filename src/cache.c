@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "cache.h"
+
+#define CACHE_DIR "cache"
+#define CACHE_MAGIC 0x32434B50
+
+/*
+ * An entry is stamped with the source's size and mtime, which lets the 
+ * common case skip reading the source at all. When the stamp is stale
+ * the source is hashed, and an entry whose content hash still matches
+ * is only restamped. A source modified in the same second the stamp was
+ * taken could change again unseen, so its stamp is never trusted.
+ */
+struct cache_hdr {
+	uint32_t magic;
+	uint32_t size;
+	uint64_t key;
+	int64_t src_size;
+	int64_t src_mtime;
+	int64_t stamped;
+};
+
+struct cache_stats g_cache_stats;
+
+static void make_cache_dir(void)
+{
+#ifdef _WIN32
+	_mkdir(CACHE_DIR);
+#else
+	mkdir(CACHE_DIR, 0777);
+#endif
+}
+
+/*in nanoseconds where the platform has them*/
+static int64_t get_mtime(const struct stat *st)
+{
+#if defined(_WIN32)
+	return (int64_t) st->st_mtime * 1000000000;
+#elif defined(__APPLE__)
+	return (int64_t) st->st_mtimespec.tv_sec * 1000000000 + 
+			st->st_mtimespec.tv_nsec;
+#else
+	return (int64_t) st->st_mtim.tv_sec * 1000000000 + 
+			st->st_mtim.tv_nsec;
+#endif
+}
+
+static void entry_path(char *out, size_t n, const char *path, int arg, 
+		int version)
+{
+	uint64_t h;
+
+	h = hash_bytes(path, strlen(path), HASH_SEED);
+	h = hash_bytes(&arg, sizeof(arg), h);
+	h = hash_bytes(&version, sizeof(version), h);
+	snprintf(out, n, CACHE_DIR "/%016llx", (unsigned long long) h);
+}
+
+static int read_entry(const char *name, struct cache_hdr *hdr, 
+		void *buf, size_t size)
+{
+	struct span s;
+	int res;
+
+	if (span_read_file(&s, name) < 0) {
+		return -1;
+	}
+
+	res = -1;
+	if (span_read(&s, hdr, sizeof(*hdr)) == 0 && 
+			hdr->magic == CACHE_MAGIC && hdr->size == size &&
+			span_read(&s, buf, size) == 0) {
+		res = 0;
+	}
+
+	span_free(&s);
+	return res;
+}
+
+static void write_entry(const char *name, const struct cache_hdr *hdr, 
+		const void *buf)
+{
+	FILE *f;
+
+	make_cache_dir();
+	f = fopen(name, "wb");
+	if (!f) {
+		return;
+	}
+	if (fwrite(hdr, sizeof(*hdr), 1, f) != 1 || 
+			fwrite(buf, hdr->size, 1, f) != 1) {
+		fclose(f);
+		remove(name);
+		return;
+	}
+	fclose(f);
+}
+
+void cache_fetch(const char *path, int arg, int version, 
+		void *buf, size_t size, cache_fn build)
+{
+	char name[64];
+	struct stat st;
+	struct cache_hdr hdr;
+	struct span src;
+	int64_t mtime;
+	int have;
+	uint64_t key;
+	double t;
+
+	t = get_time();
+
+	entry_path(name, sizeof(name), path, arg, version);
+	if (stat(path, &st) != 0) {
+		st.st_size = -1;
+		st.st_mtime = 0;
+		mtime = 0;
+	} else {
+		mtime = get_mtime(&st);
+	}
+
+	have = read_entry(name, &hdr, buf, size) == 0;
+	if (have && hdr.src_size == st.st_size && hdr.src_mtime == mtime &&
+			st.st_mtime < hdr.stamped) {
+		g_cache_stats.stat_hits++;
+		goto end;
+	}
+
+	if (span_read_file(&src, path) < 0) {
+		/*let build produce its fallback, but never cache it*/
+		fprintf(stderr, "cache: cannot read \"%s\"\n", path);
+		src.data = NULL;
+		src.len = 0;
+		src.pos = 0;
+		build(&src, buf, size, arg);
+		g_cache_stats.misses++;
+		goto end;
+	}
+
+	key = hash_bytes(src.data, src.len, HASH_SEED);
+	key = hash_bytes(&arg, sizeof(arg), key);
+	key = hash_bytes(&version, sizeof(version), key);
+	if (have && hdr.key == key) {
+		g_cache_stats.hash_hits++;
+	} else {
+		build(&src, buf, size, arg);
+		g_cache_stats.misses++;
+	}
+	span_free(&src);
+
+	hdr.magic = CACHE_MAGIC;
+	hdr.size = size;
+	hdr.key = key;
+	hdr.src_size = st.st_size;
+	hdr.src_mtime = mtime;
+	hdr.stamped = time(NULL);
+	write_entry(name, &hdr, buf);
+end:
+	g_cache_stats.time += get_time() - t;
+}
+
+static void key_path(char *out, size_t n, uint64_t key)
+{
+	snprintf(out, n, CACHE_DIR "/k%016llx", (unsigned long long) key);
+}
+
+int cache_get(uint64_t key, struct span *s)
+{
+	char name[64];
+	struct cache_hdr hdr;
+
+	key_path(name, sizeof(name), key);
+	if (span_read_file(s, name) < 0) {
+		return -1;
+	}
+
+	if (span_read(s, &hdr, sizeof(hdr)) < 0 || 
+			hdr.magic != CACHE_MAGIC || hdr.key != key ||
+			hdr.size != span_left(s)) {
+		span_free(s);
+		return -1;
+	}
+	return 0;
+}
+
+void cache_put(uint64_t key, const void *buf, size_t size)
+{
+	char name[64];
+	struct cache_hdr hdr;
+
+	key_path(name, sizeof(name), key);
+	hdr.magic = CACHE_MAGIC;
+	hdr.size = size;
+	hdr.key = key;
+	hdr.src_size = 0;
+	hdr.src_mtime = 0;
+	hdr.stamped = 0;
+	write_entry(name, &hdr, buf);
+}
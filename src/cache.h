@@ -0,0 +1,29 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xstd.h"
+
+typedef void (*cache_fn)(struct span *src, void *buf, size_t size, int arg);
+
+struct cache_stats {
+	int stat_hits;
+	int hash_hits;
+	int misses;
+	int prog_hits;
+	int prog_misses;
+	double time;
+};
+
+extern struct cache_stats g_cache_stats;
+
+/*version names build's output format, bump it whenever that changes*/
+void cache_fetch(const char *path, int arg, int version, 
+		void *buf, size_t size, cache_fn build);
+
+int cache_get(uint64_t key, struct span *s);
+void cache_put(uint64_t key, const void *buf, size_t size);
+
+#endif
@@ -0,0 +1,159 @@
+#include <glad/glad.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "headless.h"
+#include "render.h"
+#include "xstd.h"
+
+static int g_width;
+static int g_height;
+
+#ifdef HEADLESS
+static EGLDisplay g_dpy;
+static EGLContext g_ctx;
+static GLuint g_fbo;
+static GLuint g_rb;
+
+static EGLDisplay get_display(void)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+	EGLDisplay dpy;
+
+	/*surfaceless needs neither a display server nor a GPU*/
+	get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC) 
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (get_platform_display) {
+		dpy = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, 
+				EGL_DEFAULT_DISPLAY, NULL);
+		if (dpy != EGL_NO_DISPLAY) {
+			return dpy;
+		}
+	}
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static int make_context(void)
+{
+	static const EGLint attrs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, 
+		EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	EGLint major;
+	EGLint minor;
+
+	g_dpy = get_display();
+	if (g_dpy == EGL_NO_DISPLAY || !eglInitialize(g_dpy, &major, &minor)) {
+		fprintf(stderr, "headless: cannot initialize EGL\n");
+		return -1;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "headless: EGL has no desktop GL\n");
+		return -1;
+	}
+
+	/*nothing is ever presented, so no config or surface is needed*/
+	g_ctx = eglCreateContext(g_dpy, EGL_NO_CONFIG_KHR, 
+			EGL_NO_CONTEXT, attrs);
+	if (g_ctx == EGL_NO_CONTEXT) {
+		fprintf(stderr, "headless: cannot create a GL 3.3 context\n");
+		return -1;
+	}
+
+	if (!eglMakeCurrent(g_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, g_ctx)) {
+		fprintf(stderr, "headless: cannot make context current\n");
+		return -1;
+	}
+	return 0;
+}
+
+GLADloadproc headless_init(int w, int h)
+{
+	if (make_context() < 0) {
+		return NULL;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+		fprintf(stderr, "glad error\n");
+		return NULL;
+	}
+
+	glGenRenderbuffers(1, &g_rb);
+	glBindRenderbuffer(GL_RENDERBUFFER, g_rb);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+
+	glGenFramebuffers(1, &g_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, g_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 
+			GL_RENDERBUFFER, g_rb);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != 
+			GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "headless: framebuffer is incomplete\n");
+		return NULL;
+	}
+
+	set_target_fbo(g_fbo);
+	set_present_rect(0, 0, w, h);
+	g_width = w;
+	g_height = h;
+	return (GLADloadproc) eglGetProcAddress;
+}
+#else
+GLADloadproc headless_init(int w, int h)
+{
+	fprintf(stderr, "headless: not built with HEADLESS\n");
+	return NULL;
+}
+#endif
+
+void headless_read(uint8_t *rgb)
+{
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, g_width, g_height, 
+			GL_RGB, GL_UNSIGNED_BYTE, rgb);
+}
+
+int headless_dump(const char *path)
+{
+	FILE *f;
+	uint8_t *rgb;
+	size_t stride;
+	int y;
+	int res;
+
+	f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "headless: cannot write \"%s\"\n", path);
+		return -1;
+	}
+
+	stride = (size_t) g_width * 3;
+	rgb = xmalloc(stride * g_height);
+	headless_read(rgb);
+
+	/*GL rows run bottom up*/
+	fprintf(f, "P6\n%d %d\n255\n", g_width, g_height);
+	res = 0;
+	for (y = g_height - 1; y >= 0; y--) {
+		if (fwrite(rgb + y * stride, 1, stride, f) != stride) {
+			res = -1;
+		}
+	}
+	if (fclose(f) != 0 || res < 0) {
+		fprintf(stderr, "headless: short write to \"%s\"\n", path);
+		res = -1;
+	}
+
+	free(rgb);
+	return res;
+}
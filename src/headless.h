@@ -0,0 +1,11 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#include <stdint.h>
+
+GLADloadproc headless_init(int w, int h);
+void headless_read(uint8_t *rgb);
+int headless_dump(const char *path);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "input.h"
+#include "xstd.h"
+
+#define REC_MAGIC 0x52494B50
+#define REC_VERSION 1
+
+/*
+ * A recording is this header followed by one input_ev per event.
+ * Delays are in microseconds since the previous event, so a session 
+ * can run for as long as it likes without the clock overflowing.
+ */
+struct rec_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t start_hash;
+	uint64_t end_hash;
+};
+
+static FILE *g_rec;
+static struct rec_hdr g_hdr;
+static double g_last;
+
+int rec_open(const char *path, uint64_t start_hash)
+{
+	g_rec = fopen(path, "wb");
+	if (!g_rec) {
+		fprintf(stderr, "rec: cannot write \"%s\"\n", path);
+		return -1;
+	}
+
+	g_hdr.magic = REC_MAGIC;
+	g_hdr.version = REC_VERSION;
+	g_hdr.start_hash = start_hash;
+	g_hdr.end_hash = 0;
+	fwrite(&g_hdr, sizeof(g_hdr), 1, g_rec);
+	g_last = get_time();
+	return 0;
+}
+
+void rec_put(int type, int code, int scancode, int action, int mods)
+{
+	struct input_ev ev;
+	double now;
+	double us;
+
+	if (!g_rec) {
+		return;
+	}
+
+	now = get_time();
+	us = (now - g_last) * 1e6;
+	g_last = now;
+
+	ev.delay = us < UINT32_MAX ? (uint32_t) us : UINT32_MAX;
+	ev.type = type;
+	ev.action = action;
+	ev.mods = mods;
+	ev.pad = 0;
+	ev.code = code;
+	ev.scancode = scancode;
+	fwrite(&ev, sizeof(ev), 1, g_rec);
+}
+
+void rec_close(uint64_t end_hash)
+{
+	if (!g_rec) {
+		return;
+	}
+
+	g_hdr.end_hash = end_hash;
+	fseek(g_rec, 0, SEEK_SET);
+	fwrite(&g_hdr, sizeof(g_hdr), 1, g_rec);
+	if (fclose(g_rec) != 0) {
+		fprintf(stderr, "rec: recording was not fully written\n");
+	}
+	g_rec = NULL;
+}
+
+int rec_load(const char *path, struct input_log *log)
+{
+	struct span s;
+	struct rec_hdr hdr;
+	size_t size;
+
+	if (span_read_file(&s, path) < 0) {
+		fprintf(stderr, "rec: cannot read \"%s\"\n", path);
+		return -1;
+	}
+
+	if (span_read(&s, &hdr, sizeof(hdr)) < 0 || 
+			hdr.magic != REC_MAGIC || hdr.version != REC_VERSION) {
+		fprintf(stderr, "rec: \"%s\" is not a recording\n", path);
+		span_free(&s);
+		return -1;
+	}
+
+	/*a torn last event from a crashed session is dropped*/
+	log->count = span_left(&s) / sizeof(*log->evs);
+	size = log->count * sizeof(*log->evs);
+	log->evs = xmalloc(size ? size : 1);
+	span_read(&s, log->evs, size);
+	log->start_hash = hdr.start_hash;
+	log->end_hash = hdr.end_hash;
+
+	span_free(&s);
+	return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum input_type {
+	IT_KEY,
+	IT_CHAR
+};
+
+/*code is the key for IT_KEY and the codepoint for IT_CHAR*/
+struct input_ev {
+	uint32_t delay;
+	uint8_t type;
+	uint8_t action;
+	uint8_t mods;
+	uint8_t pad;
+	int32_t code;
+	int32_t scancode;
+};
+
+struct input_log {
+	struct input_ev *evs;
+	size_t count;
+	uint64_t start_hash;
+	uint64_t end_hash;
+};
+
+int rec_open(const char *path, uint64_t start_hash);
+void rec_put(int type, int code, int scancode, int action, int mods);
+void rec_close(uint64_t end_hash);
+
+int rec_load(const char *path, struct input_log *log);
+
+#endif
@@ -0,0 +1,145 @@
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "loader.h"
+
+/*
+ * Each ring has one producer and one consumer: only the producer moves
+ * tail and only the consumer moves head. ready counts the filled slots
+ * so the consumer can sleep, it guards nothing.
+ */
+struct ring {
+	struct load_res slots[LOADER_SLOTS];
+	atomic_uint head;
+	atomic_uint tail;
+	sem_t ready;
+};
+
+static struct ring g_reqs;
+static struct ring g_done;
+
+static pthread_t g_thread;
+static loader_fn g_load;
+static atomic_int g_quit;
+static int g_running;
+
+/*UI thread only, bounds both rings*/
+static int g_outstanding;
+
+static void ring_push(struct ring *r, const struct load_res *res)
+{
+	unsigned tail;
+
+	tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	r->slots[tail % LOADER_SLOTS] = *res;
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+	sem_post(&r->ready);
+}
+
+static void ring_pop(struct ring *r, struct load_res *res)
+{
+	unsigned head;
+
+	/*ready was posted after tail moved, this only pairs the release*/
+	head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	while (atomic_load_explicit(&r->tail, memory_order_acquire) == head);
+	*res = r->slots[head % LOADER_SLOTS];
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+static void sem_wait_all(sem_t *sem)
+{
+	while (sem_wait(sem) < 0 && errno == EINTR);
+}
+
+static void *run_loader(void *arg)
+{
+	struct load_res res;
+
+	for (;;) {
+		sem_wait_all(&g_reqs.ready);
+		if (atomic_load(&g_quit)) {
+			break;
+		}
+		ring_pop(&g_reqs, &res);
+		res.data = g_load(res.path);
+		ring_push(&g_done, &res);
+	}
+	return NULL;
+}
+
+int loader_start(loader_fn load)
+{
+	g_load = load;
+	if (sem_init(&g_reqs.ready, 0, 0) < 0) {
+		goto no_sem;
+	}
+	if (sem_init(&g_done.ready, 0, 0) < 0) {
+		sem_destroy(&g_reqs.ready);
+		goto no_sem;
+	}
+	if (pthread_create(&g_thread, NULL, run_loader, NULL) != 0) {
+		fprintf(stderr, "loader: cannot start thread\n");
+		sem_destroy(&g_done.ready);
+		sem_destroy(&g_reqs.ready);
+		return -1;
+	}
+	g_running = 1;
+	return 0;
+
+no_sem:
+	fprintf(stderr, "loader: cannot create semaphores\n");
+	return -1;
+}
+
+/*results still queued are dropped with the process*/
+void loader_stop(void)
+{
+	if (!g_running) {
+		return;
+	}
+	atomic_store(&g_quit, 1);
+	sem_post(&g_reqs.ready);
+	pthread_join(g_thread, NULL);
+	g_running = 0;
+}
+
+int loader_request(const char *path)
+{
+	struct load_res res;
+
+	if (!g_running || g_outstanding == LOADER_SLOTS ||
+			strlen(path) >= LOADER_PATH) {
+		return -1;
+	}
+	strcpy(res.path, path);
+	res.data = NULL;
+	ring_push(&g_reqs, &res);
+	g_outstanding++;
+	return 0;
+}
+
+int loader_take(struct load_res *res)
+{
+	if (!g_outstanding || sem_trywait(&g_done.ready) < 0) {
+		return -1;
+	}
+	ring_pop(&g_done, res);
+	g_outstanding--;
+	return 0;
+}
+
+int loader_wait(struct load_res *res)
+{
+	if (!g_outstanding) {
+		return -1;
+	}
+	sem_wait_all(&g_done.ready);
+	ring_pop(&g_done, res);
+	g_outstanding--;
+	return 0;
+}
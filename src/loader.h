@@ -0,0 +1,26 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#define LOADER_SLOTS 16
+#define LOADER_PATH 16
+
+/*
+ * Runs on the loader thread, so it may only touch what it allocates.
+ * NULL means the load failed.
+ */
+typedef void *(*loader_fn)(const char *path);
+
+struct load_res {
+	char path[LOADER_PATH];
+	void *data;
+};
+
+int loader_start(loader_fn load);
+void loader_stop(void);
+
+/*at most LOADER_SLOTS requests are outstanding, -1 past that*/
+int loader_request(const char *path);
+int loader_take(struct load_res *res);
+int loader_wait(struct load_res *res);
+
+#endif
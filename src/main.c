@@ -1,13 +1,32 @@
 #include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <limits.h>
+#include <unistd.h>
+#define MAX_PATH PATH_MAX
+#endif
 
 #include <glad/glad.h>
-#include <glfw/glfw3.h>
+#include <GLFW/glfw3.h>
 
+#include "cache.h"
+#include "headless.h"
+#include "input.h"
+#include "loader.h"
+#include "map.h"
 #include "render.h"
+#include "soft.h"
+#include "stats.h"
+#include "tile.h"
+#include "undo.h"
 #include "xstd.h"
 
 #define WND_WIDTH 640 
@@ -15,8 +34,6 @@
 
 #define SIZEOF_TILE_MAP (TILE_MAP_LEN * TILE_MAP_LEN) 
 
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
-
 #define TEXT_SIZE 256
 
 #define TF_PLACE 1
@@ -29,10 +46,45 @@
 
 #define MAX_MAP_PATH 16 
 
+#ifdef _WIN32
+#define PATH_SEP '\\'
+#else
+#define PATH_SEP '/'
+#endif
+
 #define MAX_TEXTS 32 
 #define MAX_OBJS  32 
 #define MAX_DOORS 32 
 
+#define MAX_MAPS 64
+#define MAP_BUDGET (1024 * 1024)
+#define MAX_RECENT 8
+#define MAX_MAP_NAMES 256
+
+#define TRACE_CAP 256
+
+#define HUD_X1 20
+#define HUD_Y1 10
+#define UNDO_BUDGET (512 * 1024)
+
+#define VIEW_QUADS_X 10
+#define VIEW_QUADS_Y 9
+#define CAM_MIN_SPEED 64.0
+#define CAM_MAX_SPEED 512.0
+#define CAM_ACCEL 768.0
+#define CAM_MAX_DT 0.05
+#define CAM_IDLE_WAIT 0.002
+
+#define BENCH_SCREEN_RUNS 20000
+#define BENCH_MAP_RUNS 2000
+#define BENCH_LOAD_RUNS 200
+#define BENCH_DECOMP_RUNS 200
+#define BENCH_TILES 4096
+#define BENCH_TILE_RUNS 200
+
+#define MAX_MAP_FILE (2 + 256 * 256 + 2 + MAX_TEXTS * (3 + TEXT_SIZE) + \
+		1 + MAX_OBJS * (6 + TEXT_SIZE))
+
 typedef uint8_t map_row[256];
 
 enum menu_tile {
@@ -112,6 +164,13 @@ struct text {
 	char str[TEXT_SIZE];
 };
 
+enum obj_field {
+	OF_DIR,
+	OF_SPEED,
+	OF_TILE,
+	OF_STR
+};
+
 struct object {
 	struct v2b pos;
 	uint8_t dir;
@@ -120,6 +179,39 @@ struct object {
 	char str[TEXT_SIZE];
 };
 
+/*
+ * One map of the workspace, rows past height are not allocated. cam is
+ * where the camera was when another map was opened.
+ */
+struct map {
+	char path[MAX_MAP_PATH];
+	int width;
+	int height;
+	int def_quad;
+	map_row *data;
+
+	int text_count;
+	struct text texts[MAX_TEXTS];
+
+	int object_count;
+	struct object objects[MAX_OBJS];
+
+	ivec2 cam;
+	int dirty;
+	unsigned long used;
+};
+
+/*positions in the clipboard are relative to its top left*/
+struct clip {
+	int w;
+	int h;
+	map_row data[256];
+	int text_count;
+	struct text texts[MAX_TEXTS];
+	int object_count;
+	struct object objects[MAX_OBJS];
+};
+
 static const char g_prop_strs[][6] = { 
 	"None ",
 	"Solid",
@@ -141,17 +233,27 @@ static int g_vw = WND_WIDTH;
 static int g_vh = WND_HEIGHT;
 
 static ivec2 g_cam;
+static ivec2 g_cam_px;
+static ivec2 g_cam_dir;
+static double g_cam_speed;
+static double g_cam_rem;
+static int g_smooth;
 
-static int g_qm_width;
-static int g_qm_height;
-static map_row g_qm_data[256];
-static int g_def_quad;
+static struct v2b g_mark;
+static int g_marked;
 
-static int g_text_count;
-static struct text g_texts[MAX_TEXTS];
+static struct map *g_maps[MAX_MAPS];
+static int g_map_count;
+static size_t g_maps_size;
+static unsigned long g_map_clock;
+static struct map *g_map;
 
-static int g_object_count;
-static struct object g_objects[MAX_OBJS];
+static char g_recent[MAX_RECENT][MAX_MAP_PATH];
+static char g_pending[LOADER_SLOTS][MAX_MAP_PATH];
+static int g_pending_count;
+static int g_loading;
+
+static struct clip g_clip;
 
 static uint8_t g_quad_data[128][2][2];
 static uint8_t g_qprops[128];
@@ -194,10 +296,46 @@ static struct sel g_msel = {
 	.blank = MT_BLANK
 };
 
-static char g_path[MAX_MAP_PATH];
-
 static uint8_t g_txt_flags;
 
+static double g_startup_time;
+static const char *g_trace_path;
+
+static unsigned long g_frames_drawn;
+static unsigned long g_frames_idle;
+static double g_render_time;
+
+static GLFWkeyfun g_key_fn;
+static GLFWcharfun g_char_fn;
+
+enum hud_stat {
+	HS_CPU,
+	HS_MAP,
+	HS_WIN,
+	HS_UP,
+	HS_TS,
+	HS_EV,
+	HS_PX,
+	HS_COUNT
+};
+
+static int g_replaying;
+static int g_headless;
+
+static int g_hud;
+static struct stat_ring g_hud_stats[HS_COUNT];
+static unsigned long g_events;
+static unsigned long g_restreamed;
+static unsigned long g_scrolled;
+static unsigned long g_scrolled_total;
+static unsigned long g_stream_lines;
+static double g_stream_time;
+
+static unsigned long g_map_hits;
+static unsigned long g_map_waits;
+static unsigned long g_map_misses;
+static unsigned long g_prefetched;
+
 static void error_cb(int code, const char *description)
 {
 	fprintf(stderr, "glfw error (%d): %s", code, description);
@@ -221,12 +359,20 @@ static void resize_cb(GLFWwindow *wnd, int w, int h)
 	g_vx = (w - g_vw) / 2;
 	g_vy = (h - g_vh) / 2;
 
-	glViewport(g_vx, g_vy, g_vw, g_vh);
+	set_present_rect(g_vx, g_vy, g_vw, g_vh);
+	g_events++;
+	damage();
+}
+
+static void refresh_cb(GLFWwindow *wnd)
+{
+	g_events++;
+	damage();
 }
 
 static int q_in_bounds(int qx, int qy)
 {
-	return qx >= 0 && qx < g_qm_width && qy >= 0 && qy < g_qm_height;
+	return qx >= 0 && qx < g_map->width && qy >= 0 && qy < g_map->height;
 }
 
 static void q_to_t(int tx, int ty, int d)
@@ -245,119 +391,258 @@ static void q_to_t(int tx, int ty, int d)
 	g_tms.tm[ty0][tx1] = q[0][1];
 	g_tms.tm[ty1][tx0] = q[1][0];
 	g_tms.tm[ty1][tx1] = q[1][1];
+	mark_rows(&g_tms, ty0, 2);
 }
 
 static void mq_to_t(int tx, int ty, int qx, int qy)
 {
 	int d;
+
+	/*the quad shader reads g_map->data itself*/
+	if (g_qms.active) {
+		return;
+	}
 	
-	d = q_in_bounds(qx, qy) ? g_qm_data[qy][qx] : g_def_quad;
+	d = q_in_bounds(qx, qy) ? g_map->data[qy][qx] : g_map->def_quad;
 	q_to_t(tx, ty, d);
+	g_restreamed += 4;
+}
+
+static void get_quad_row(uint8_t *ids, int qx, int qy, int n)
+{
+	int x0, x1;
+
+	if (qy < 0 || qy >= g_map->height) {
+		memset(ids, g_map->def_quad, n);
+		return;
+	}
+
+	/*ids before x0 and from x1 on are off the map*/
+	x0 = MIN(MAX(-qx, 0), n);
+	x1 = MIN(MAX(g_map->width - qx, x0), n);
+	memset(ids, g_map->def_quad, x0);
+	memcpy(ids + x0, g_map->data[qy] + qx + x0, x1 - x0);
+	memset(ids + x1, g_map->def_quad, n - x1);
+}
+
+static void put_ring_row(uint8_t *row, const uint8_t *src, int tx, int n)
+{
+	int k;
+
+	tx &= TILE_MAP_LEN - 1;
+	k = MIN(n, TILE_MAP_LEN - tx);
+	memcpy(row + tx, src, k);
+	memcpy(row, src + k, n - k);
 }
 
 static void qm_to_tm(ivec2 t, ivec4 q)
 {
+	uint8_t ids[TILE_MAP_LEN / 2];
+	uint8_t top[TILE_MAP_LEN];
+	uint8_t bot[TILE_MAP_LEN];
 	int ty;
 	int qy;
+	int n;
+
+	if (g_qms.active) {
+		return;
+	}
+
+	/*the ring only holds 16 quads across*/
+	n = MIN(q[2] - q[0], TILE_MAP_LEN / 2);
+	if (n <= 0) {
+		return;
+	}
 
 	ty = t[1];
 	for (qy = q[1]; qy < q[3]; qy++) {
-		int tx;
-		int qx;
-
-		tx = t[0];
-		for (qx = q[0]; qx < q[2]; qx++) {
-			mq_to_t(tx, ty, qx, qy);
-			tx += 2;
-			tx &= 31;
-		}
-		ty += 2;
 		ty &= 31;
+		get_quad_row(ids, q[0], qy, n);
+		expand_quads(**g_quad_data, ids, n, top, bot);
+		put_ring_row(g_tms.tm[ty], top, t[0], n * 2);
+		put_ring_row(g_tms.tm[(ty + 1) & 31], bot, t[0], n * 2);
+		mark_rows(&g_tms, ty, 2);
+		g_restreamed += n * 4;
+		ty += 2;
 	}
 }
 
-static void move_cam_left(void)
+static void set_quad(int qx, int qy, int d)
 {
-	if (g_cam[0] > 0) {
-		ivec2 t;
-		ivec4 q;
+	g_map->data[qy][qx] = d;
+	if (g_render_path == RP_QUAD) {
+		qm_set_cell(qx, qy, d);
+	}
+}
 
-		g_cam[0]--;
-		g_tms.scroll.x -= 16;
+static void set_quad_tile(int d, int i, int t)
+{
+	g_quad_data[d][i / 2][i % 2] = t;
+	if (g_render_path == RP_QUAD) {
+		qm_set_quad_tile(d, i, t);
+	}
+}
+
+static void sync_cam(void)
+{
+	g_qms.cam[0] = g_cam_px[0];
+	g_qms.cam[1] = g_cam_px[1];
+}
 
-		t[0] = (g_tms.scroll.x / 8) & 31;
-		t[1] = (g_tms.scroll.y / 8) & 31;
+/*
+ * The ring keeps a quad of margin on every side of the view, 
+ * quad (qx, qy) always lives at ring tile (qx * 2, qy * 2)
+ */
+static void stream_col(int qx)
+{
+	ivec2 t;
+	ivec4 q;
 
-		q[0] = g_cam[0];
-		q[1] = g_cam[1];
-		q[2] = g_cam[0] + 1;
-		q[3] = g_cam[1] + 9;
+	t[0] = qx * 2;
+	t[1] = (g_cam[1] - 1) * 2;
 
-		qm_to_tm(t, q);
-	}
+	q[0] = qx;
+	q[1] = g_cam[1] - 1;
+	q[2] = qx + 1;
+	q[3] = g_cam[1] + VIEW_QUADS_Y + 1;
+
+	qm_to_tm(t, q);
+	g_stream_lines++;
 }
 
-static void move_cam_right(void)
+static void stream_row(int qy)
 {
-	if (g_cam[0] < g_qm_width - 10) {
-		ivec2 t;
-		ivec4 q;
+	ivec2 t;
+	ivec4 q;
 
-		g_cam[0]++;
-		g_tms.scroll.x += 16;
+	t[0] = (g_cam[0] - 1) * 2;
+	t[1] = qy * 2;
 
-		t[0] = (g_tms.scroll.x / 8 + 18) & 31;
-		t[1] = (g_tms.scroll.y / 8) & 31;
+	q[0] = g_cam[0] - 1;
+	q[1] = qy;
+	q[2] = g_cam[0] + VIEW_QUADS_X + 1;
+	q[3] = qy + 1;
 
-		q[0] = g_cam[0] + 9;
-		q[1] = g_cam[1]; 
-		q[2] = g_cam[0] + 10;
-		q[3] = g_cam[1] + 9;
+	qm_to_tm(t, q);
+	g_stream_lines++;
+}
 
-		qm_to_tm(t, q);
+static void restream_rect(int x0, int y0, int x1, int y1)
+{
+	ivec2 t;
+	ivec4 q;
+
+	/*only the part that is in the ring*/
+	q[0] = MAX(x0, g_cam[0] - 1);
+	q[1] = MAX(y0, g_cam[1] - 1);
+	q[2] = MIN(x1, g_cam[0] + VIEW_QUADS_X + 1);
+	q[3] = MIN(y1, g_cam[1] + VIEW_QUADS_Y + 1);
+	if (q[0] >= q[2] || q[1] >= q[3]) {
+		return;
 	}
+
+	t[0] = q[0] * 2;
+	t[1] = q[1] * 2;
+	qm_to_tm(t, q);
 }
 
-static void move_cam_down(void)
+static void show_mark(int tile)
 {
-	if (g_cam[1] < g_qm_height - 9) {
-		ivec2 t;
-		ivec4 q;
+	int x, y;
 
-		g_cam[1]++;
-		g_tms.scroll.y += 16;
+	if (!g_marked) {
+		return;
+	}
+
+	x = (g_mark.x - g_cam[0]) * 2;
+	y = (g_mark.y - g_cam[1]) * 2;
+	if (x < 0 || x >= VIEW_QUADS_X * 2 || 
+			y < 0 || y >= VIEW_QUADS_Y * 2) {
+		return;
+	}
+	if (x == g_qm_sel.pos.x && y == g_qm_sel.pos.y) {
+		return;
+	}
+	set_tile(&g_wms, x, y, tile);
+}
 
-		t[0] = (g_tms.scroll.x / 8) & 31;
-		t[1] = (g_tms.scroll.y / 8 + 16) & 31;
+static void scroll_cam(int dx, int dy)
+{
+	int x, y;
+	double t;
 
-		q[0] = g_cam[0];
-		q[1] = g_cam[1] + 8; 
-		q[2] = g_cam[0] + 10;
-		q[3] = g_cam[1] + 9;
+	x = g_cam_px[0] + dx;
+	y = g_cam_px[1] + dy;
+	x = MAX(MIN(x, (g_map->width - VIEW_QUADS_X) * 16), 0);
+	y = MAX(MIN(y, (g_map->height - VIEW_QUADS_Y) * 16), 0);
+	if (x == g_cam_px[0] && y == g_cam_px[1]) {
+		return;
+	}
 
-		qm_to_tm(t, q);
+	/*one line per quad crossed, a fast frame must not leave holes*/
+	show_mark(g_qm_sel.blank);
+	t = get_time();
+	while (g_cam[0] < x / 16) {
+		g_cam[0]++;
+		stream_col(g_cam[0] + VIEW_QUADS_X);
+	}
+	while (g_cam[0] > x / 16) {
+		g_cam[0]--;
+		stream_col(g_cam[0] - 1);
+	}
+	while (g_cam[1] < y / 16) {
+		g_cam[1]++;
+		stream_row(g_cam[1] + VIEW_QUADS_Y);
+	}
+	while (g_cam[1] > y / 16) {
+		g_cam[1]--;
+		stream_row(g_cam[1] - 1);
 	}
+	g_stream_time += get_time() - t;
+
+	g_scrolled += abs(x - g_cam_px[0]) + abs(y - g_cam_px[1]);
+	g_cam_px[0] = x;
+	g_cam_px[1] = y;
+	g_tms.scroll.x = x & 255;
+	g_tms.scroll.y = y & 255;
+	show_mark(MT_EMPTY_HORZ_ARROW);
+	sync_cam();
+	damage();
 }
 
-static void move_cam_up(void)
+static void step_cam(int dx, int dy)
 {
-	if (g_cam[1] > 0) {
-		ivec2 t;
-		ivec4 q;
+	if (!g_smooth) {
+		scroll_cam(dx * 16, dy * 16);
+		return;
+	}
 
-		g_cam[1]--;
-		g_tms.scroll.y -= 16;
+	/*held keys are polled by glide_cam, this only starts a glide*/
+	if (dx) {
+		g_cam_dir[0] = dx;
+	}
+	if (dy) {
+		g_cam_dir[1] = dy;
+	}
+	scroll_cam(dx, dy);
+}
 
-		t[0] = (g_tms.scroll.x / 8) & 31;
-		t[1] = (g_tms.scroll.y / 8) & 31;
+static void settle_cam(void)
+{
+	int d[2];
+	int i;
 
-		q[0] = g_cam[0];
-		q[1] = g_cam[1]; 
-		q[2] = g_cam[0] + 10;
-		q[3] = g_cam[1] + 1;
+	for (i = 0; i < 2; i++) {
+		int sub;
 
-		qm_to_tm(t, q);
+		sub = g_cam_px[i] % 16;
+		d[i] = 0;
+		if (sub) {
+			d[i] = g_cam_dir[i] < 0 ? -sub : 16 - sub;
+		}
+		g_cam_dir[i] = 0;
 	}
+	scroll_cam(d[0], d[1]);
 }
 
 static void open_qsel();
@@ -375,12 +660,12 @@ static void rel_sel(struct sel *s, struct v2b *rel)
 
 static void place_sel(struct sel *s)
 {
-	g_wms.tm[s->pos.y][s->pos.x] = MT_FULL_HORZ_ARROW;
+	set_tile(&g_wms, s->pos.x, s->pos.y, MT_FULL_HORZ_ARROW);
 }
 
 static void remove_sel(struct sel *s)
 {
-	g_wms.tm[s->pos.y][s->pos.x] = s->blank;
+	set_tile(&g_wms, s->pos.x, s->pos.y, s->blank);
 }
 
 static void move_sel(struct sel *s, int dx, int dy) 
@@ -412,7 +697,7 @@ static int move_sel_kb(int key, struct sel *s)
 
 static void destroy_text(struct text *t)
 {
-	*t = g_texts[--g_text_count];
+	*t = g_map->texts[--g_map->text_count];
 }
 
 static struct text *find_text(int x, int y)
@@ -420,8 +705,8 @@ static struct text *find_text(int x, int y)
 	struct text *t;
 	int n;
 
-	t = g_texts;
-	n = g_text_count;
+	t = g_map->texts;
+	n = g_map->text_count;
 	while (n--) {
 		if (t->pos.x == x && t->pos.y == y) {
 			return t;
@@ -440,1357 +725,3710 @@ static struct text *get_text(int x, int y)
 		return t;
 	}
 
-	if (g_text_count >= MAX_TEXTS) {
+	if (g_map->text_count >= MAX_TEXTS) {
 		return NULL;
 	}
 
-	t = g_texts + g_text_count++;
-	t->pos.x = 0;
-	t->pos.y = 0;
+	t = g_map->texts + g_map->text_count++;
+	t->pos.x = x;
+	t->pos.y = y;
 	*t->str = 0;
 	return t;
 }
 
-static void place_quad(void)
+/*every record of the map's own state also marks it unsaved*/
+static void push_edit(int kind, int x, int y, int idx, int old, int new)
+{
+	g_map->dirty = 1;
+	undo_push(kind, x, y, idx, old, new);
+}
+
+static void free_text(struct text *t)
+{
+	int i;
+
+	i = strlen(t->str);
+	while (i-- > 0) {
+		push_edit(UK_DEL, t->pos.x, t->pos.y, i, t->str[i], 0);
+	}
+	push_edit(UK_FREE, t->pos.x, t->pos.y, 0, 0, 0);
+	destroy_text(t);
+}
+
+static void place_quad(int repeat)
 {	
 	int tx, ty;
 	int qx, qy;
 	uint8_t *q;
 
-	tx = g_qm_sel.pos.x + g_tms.scroll.x / 8; 
-	ty = g_qm_sel.pos.y + g_tms.scroll.y / 8; 
+	tx = g_qm_sel.pos.x + g_cam[0] * 2; 
+	ty = g_qm_sel.pos.y + g_cam[1] * 2; 
 
 	qx = g_cam[0] + g_qm_sel.pos.x / 2;
 	qy = g_cam[1] + g_qm_sel.pos.y / 2;
 
-	q = &g_qm_data[qy][qx]; 
-	if (g_qprops[*q] & QP_MSG) {
-		struct text *t;
+	q = &g_map->data[qy][qx]; 
+	if (!repeat || !undo_coalesce(UK_QUAD, qx, qy, 0, g_place)) {
+		undo_begin();
+		if (g_qprops[*q] & QP_MSG) {
+			struct text *t;
 
-		t = find_text(qx, qy);
-		if (t) {
-			destroy_text(t);
+			t = find_text(qx, qy);
+			if (t) {
+				free_text(t);
+			}
+		} else if (g_qprops[*q] & QP_DOOR) {
 		}
-	} else if (g_qprops[*q] & QP_DOOR) {
+		push_edit(UK_QUAD, qx, qy, 0, *q, g_place);
 	}
-	*q = g_place; 
+	set_quad(qx, qy, g_place); 
 
 	mq_to_t(tx, ty, qx, qy);
 }
 
-static int ch_to_tile(int ch) 
+static void snap_texts(uint8_t *was)
 {
-	switch(ch) {
-	case ' ':
-		return MT_BLANK;
-	case '0' ... '9':
-		return MT_ZERO + (ch - '0');
-	case ':':
-		return MT_COLON;
-	case 'A' ... 'Z':
-		return MT_CAPITAL_A + (ch - 'A');
-	case 'a' ... 'z':
-		return MT_LOWERCASE_A + (ch - 'a');
-	case '\xE9':
-		return MT_ACCENTED_E;
-	case '!':
-		return MT_EXCLAMATION_POINT;
-	case '\'':
-		return MT_QUOTE_S;
-	case '-':
-		return MT_DASH;
-	case '~':
-		return MT_QUOTE_M;
-	case ',':
-		return MT_COMMA;
-	case '.':
-		return MT_PERIOD;
-	case ';':
-		return MT_SEMI_COLON;
-	case '[':
-		return MT_LEFT_BRACKET;
-	case ']':
-		return MT_RIGHT_BRACKET; 
-	case '(':
-		return MT_LEFT_PARENTHESIS;
-	case ')':
-		return MT_RIGHT_PARENTHESIS;
-	case '^':
-		return MT_MALE_SYMBOL;
-	case '|':
-		return MT_FEMALE_SYMBOL;
-	case '/':
-		return MT_SLASH;
-	case '\1':
-		return MT_PK;
-	case '\2':
-		return MT_MN;
-	case '=':
-		return MT_MIDDLE_SCORE;
-	case '_':
-		return MT_UPPER_SCORE;
-	case '\3':
-		return MT_END;
-	case '*': 
-		return MT_TIMES;
-	case '?':
-		return MT_QUESTION;
+	int i;
+
+	for (i = 0; i < g_map->text_count; i++) {
+		struct v2b *p;
+
+		p = &g_map->texts[i].pos;
+		was[i] = g_map->data[p->y][p->x];
 	}
-	return MT_EMPTY;
 }
 
-static void place_text(int x0, int y0, const char *text)
+static void free_stale_texts(const uint8_t *was)
 {
-	const char *t;
-	int x;
-	int y;
+	int i;
 
-	x = x0;
-	y = y0;
+	/*one pass, free_text moves the last text into the freed slot*/
+	i = g_map->text_count;
+	while (i-- > 0) {
+		struct text *t;
 
-	t = text;
-	while (*t) {
-		switch (*t) {
-		case '\n':
-			x = x0; 
-			y += 2;
-			break;
-		default:
-			g_wms.tm[y][x] = ch_to_tile(*t);
-			x++;
+		t = g_map->texts + i;
+		if (g_qprops[was[i]] == QP_MSG && 
+				g_map->data[t->pos.y][t->pos.x] != was[i]) {
+			free_text(t);
 		}
-		t++;
 	}
 }
 
-static void place_textf(int x0, int y0, const char *fmt, ...)
+static void fill_cell(int x, int y, int d)
 {
-	va_list ap;
-	char buf[360];
-
-	va_start(ap, fmt);
-	vsnprintf(buf, 360, fmt, ap);
-	va_end(ap);
-
-	place_text(x0, y0, buf);
+	push_edit(UK_QUAD, x, y, 0, g_map->data[y][x], d);
+	g_map->data[y][x] = d;
 }
 
-static void place_row(uint8_t *row, int x0, int x1, int l, int c, int r)
+static void end_fill(const uint8_t *was, int x0, int y0, int x1, int y1)
 {
-	int iw;
-
-	iw = x1 - x0 - 2;
-	row[x0] = l;
-	memset(row + x0 + 1, c, iw);
-	row[x1 - 1] = r;
+	free_stale_texts(was);
+	if (g_render_path == RP_QUAD) {
+		qm_upload_rows(*g_map->data, y0, y1 - y0);
+	}
+	restream_rect(x0, y0, x1, y1);
 }
 
-static void place_box(int x0, int y0, int x1, int y1)
+static void fill_rect(int x0, int y0, int x1, int y1, int d)
 {
-	tile_row *row;
-	int n;
+	uint8_t was[MAX_TEXTS];
+	int y;
 
-	row = g_wms.tm + y0;
-	place_row(*row, x0, x1, MT_TOP_LEFT, MT_MIDDLE, MT_TOP_RIGHT);
+	snap_texts(was);
+	undo_begin();
+	for (y = y0; y < y1; y++) {
+		int x;
 
-	n = y1 - y0 - 2;
-	while (n-- > 0) {
-		row++;
-		place_row(*row, x0, x1, MT_CENTER_LEFT, 
-				MT_BLANK, MT_CENTER_RIGHT);
+		for (x = x0; x < x1; x++) {
+			if (g_map->data[y][x] != d) {
+				fill_cell(x, y, d);
+			}
+		}
 	}
-
-	place_row(*row, x0, x1, MT_BOTTOM_LEFT, MT_MIDDLE, MT_BOTTOM_RIGHT);
+	end_fill(was, x0, y0, x1, y1);
 }
 
-static void clear_wm(void)
+static void flood_fill(int x, int y, int d)
 {
-	memset(g_wms.tm, 0, sizeof(g_wms.tm));
-}
+	uint8_t was[MAX_TEXTS];
+	struct v2b *seeds;
+	int n;
+	int old;
+	int x0, y0;
+	int x1, y1;
 
-static void open_edit(void);
+	old = g_map->data[y][x];
+	if (old == d) {
+		return;
+	}
 
-static char *g_base;
-static char *g_lines[3];
-static struct v2b g_cursor; 
+	snap_texts(was);
+	undo_begin();
 
-static int is_sep(int ch)
-{
-	return isspace(ch) || ch == '-'; 
-}
+	/*each filled cell seeds at most one run above and one below*/
+	seeds = xmalloc((2 * g_map->width * g_map->height + 1) * sizeof(*seeds));
+	seeds->x = x;
+	seeds->y = y;
+	n = 1;
 
-static size_t word_len(const char *str)
-{
-	const char *s;
+	x0 = x;
+	y0 = y;
+	x1 = x + 1;
+	y1 = y + 1;
+	while (n > 0) {
+		uint8_t *row;
+		int l, r;
+		int ny;
+
+		n--;
+		row = g_map->data[seeds[n].y];
+		l = seeds[n].x;
+		r = l;
+		if (row[l] != old) {
+			continue;
+		}
 
-	s = str;
-	if (is_sep(*s)) {
-		while (*s && is_sep(*s)) {
-			s++;
+		while (l > 0 && row[l - 1] == old) {
+			l--;
 		}
-	} else {
-		while (*s && !is_sep(*s)) {
-			s++;
+		while (r + 1 < g_map->width && row[r + 1] == old) {
+			r++;
 		}
-	}
 
-	return s - str;
+		y = seeds[n].y;
+		for (x = l; x <= r; x++) {
+			fill_cell(x, y, d);
+		}
+		x0 = MIN(x0, l);
+		x1 = MAX(x1, r + 1);
+		y0 = MIN(y0, y);
+		y1 = MAX(y1, y + 1);
+
+		for (ny = y - 1; ny <= y + 1; ny += 2) {
+			uint8_t *next;
+
+			if (ny < 0 || ny >= g_map->height) {
+				continue;
+			}
+
+			next = g_map->data[ny];
+			for (x = l; x <= r; x++) {
+				if (next[x] != old) {
+					continue;
+				}
+				if (x == l || next[x - 1] != old) {
+					seeds[n].x = x;
+					seeds[n].y = ny;
+					n++;
+				}
+			}
+		}
+	}
+	free(seeds);
+	end_fill(was, x0, y0, x1, y1);
 }
 
-static char *next_line(char *line)
+static void fill_at_sel(int rect)
 {
-	char *s;
-	size_t n;
-		
-	s = line;
-	n = 17;
-	while (*s) {
-		char *newline;
-		size_t len;
-
-		/*when newline is not needed but still used*/
-		if (*s == '\n') {
-			s++;
-		}
-
-		len = word_len(s);
-		if (len > 17) {
-			len = 17;
-		}
-
-		if (len > n) {
-			return s;
-		}
+	int qx, qy;
 
-		n -= len;
-		
-		newline = memchr(s, '\n', len + 1);
-		if (newline) {
-			return newline + 1;
-		}
-		s += len;
+	qx = g_cam[0] + g_qm_sel.pos.x / 2;
+	qy = g_cam[1] + g_qm_sel.pos.y / 2;
+	if (!rect) {
+		flood_fill(qx, qy, g_place);
+	} else if (g_marked) {
+		fill_rect(MIN(qx, g_mark.x), MIN(qy, g_mark.y), 
+				MAX(qx, g_mark.x) + 1, MAX(qy, g_mark.y) + 1, 
+				g_place);
 	}
-	return s;
 }
 
-static size_t word_len_rev(const char *str, const char *base)
+static void get_sel_rect(ivec4 r)
 {
-	const char *s;
+	int qx, qy;
 
-	s = str;
-	if (is_sep(s[-1])) {
-		while (s > base && is_sep(s[-1])) {
-			s--;
-		}
+	qx = g_cam[0] + g_qm_sel.pos.x / 2;
+	qy = g_cam[1] + g_qm_sel.pos.y / 2;
+	if (!g_marked) {
+		r[0] = qx;
+		r[1] = qy;
 	} else {
-		while (s > base && !is_sep(s[-1])) {
-			s--;
-		}
+		r[0] = MIN(qx, g_mark.x);
+		r[1] = MIN(qy, g_mark.y);
+		qx = MAX(qx, g_mark.x);
+		qy = MAX(qy, g_mark.y);
 	}
-	return str - s;
+	r[2] = qx + 1;
+	r[3] = qy + 1;
 }
 
-static char *prev_line(char *line, char *base)
+static int in_rect(const ivec4 r, int x, int y)
 {
-	char *s;
-	size_t n;
+	return x >= r[0] && x < r[2] && y >= r[1] && y < r[3];
+}
 
-	s = line;
-	n = 17;
+static void copy_sel(void)
+{
+	ivec4 r;
+	int y;
+	int i;
 
-	while (s > base) {
-		char *newline;
-		size_t len;
+	get_sel_rect(r);
+	g_clip.w = r[2] - r[0];
+	g_clip.h = r[3] - r[1];
+	for (y = 0; y < g_clip.h; y++) {
+		memcpy(g_clip.data[y], g_map->data[r[1] + y] + r[0], g_clip.w);
+	}
 
-		if (s[-1] == '\n') {
-			s--;
-		}
+	g_clip.text_count = 0;
+	for (i = 0; i < g_map->text_count; i++) {
+		const struct text *t;
+		struct text *c;
 
-		len = word_len_rev(s, base); 
-		if (len > 17) {
-			len = 17;
+		t = g_map->texts + i;
+		if (!*t->str || !in_rect(r, t->pos.x, t->pos.y)) {
+			continue;
 		}
+		c = g_clip.texts + g_clip.text_count++;
+		*c = *t;
+		c->pos.x -= r[0];
+		c->pos.y -= r[1];
+	}
 
-		if (len > n) {
-			return s;
-		}
+	g_clip.object_count = 0;
+	for (i = 0; i < g_map->object_count; i++) {
+		const struct object *o;
+		struct object *c;
 
-		n -= len;
-		
-		newline = memchr(s - len - 1, '\n', len + 1);
-		if (newline) {
-			return newline + 1;
+		o = g_map->objects + i;
+		if (!in_rect(r, o->pos.x, o->pos.y)) {
+			continue;
 		}
-		s -= len;
+		c = g_clip.objects + g_clip.object_count++;
+		*c = *o;
+		c->pos.x -= r[0];
+		c->pos.y -= r[1];
 	}
-
-	return s;
 }
 
-static void place_lines(void)
+static void set_obj_field(struct object *o, int field, int idx, int val)
 {
-	int y;
-	char **ps;
-
-	y = 14;
-	ps = g_lines;
-	while (y <= 16) {
-		int x;
-		const char *s, *end;
-
-		/*place text*/
-		x = 1;
-		s = ps[0];
-		end = ps[1];
-		while (s < end && *s != '\n') {
-			if (x == g_cursor.x && y == g_cursor.y) {
-				g_wms.tm[y][x] = MT_FULL_HORZ_ARROW; 
-			} else {
-				g_wms.tm[y][x] = ch_to_tile(*s);
-				s++;
-			}
-			x++;
-		}
-
-		/*pad text with blank tiles*/
-		for (; x < 19; x++) {
-			if (x == g_cursor.x && y == g_cursor.y) {
-				g_wms.tm[y][x] = MT_FULL_HORZ_ARROW; 
-			} else {
-				g_wms.tm[y][x] = MT_BLANK;
-			}
-		}
-
-		/*next line*/
-		y += 2;
-		ps++;
+	switch (field) {
+	case OF_DIR:
+		o->dir = val;
+		break;
+	case OF_SPEED:
+		o->speed = val;
+		break;
+	case OF_TILE:
+		o->tile = val;
+		break;
+	case OF_STR:
+		o->str[idx] = val;
+		break;
 	}
 }
 
-
-static char *cur_lptr(void)
+/*objects keep their order, so undo records can name them by index*/
+static void insert_obj(int i, int x, int y)
 {
-	return g_lines[(g_cursor.y - 14) / 2];
-}
+	struct object *o;
 
-static char *next_lptr(void)
-{
-	return g_lines[(g_cursor.y - 14) / 2 + 1];
+	o = g_map->objects + i;
+	memmove(o + 1, o, (g_map->object_count - i) * sizeof(*o));
+	g_map->object_count++;
+	memset(o, 0, sizeof(*o));
+	o->pos.x = x;
+	o->pos.y = y;
 }
 
-static size_t dif_line(void)
+static void remove_obj(int i)
 {
-	return next_lptr() - cur_lptr();
-}
+	struct object *o;
 
-static int is_single_line(void)
-{
-	return g_lines[1] == g_lines[2];
+	g_map->object_count--;
+	o = g_map->objects + i;
+	memmove(o, o + 1, (g_map->object_count - i) * sizeof(*o));
 }
 
-static void horz_cursor_lim(void)
+static void free_obj(int i)
 {
-	size_t dif;
-	dif = dif_line() + 1;
-	g_cursor.x = MIN(g_cursor.x, dif);
+	struct object *o;
+	int n;
+
+	o = g_map->objects + i;
+	n = strlen(o->str);
+	while (n-- > 0) {
+		push_edit(UK_OSET, i, OF_STR, n, o->str[n], 0);
+	}
+	push_edit(UK_OSET, i, OF_TILE, 0, o->tile, 0);
+	push_edit(UK_OSET, i, OF_SPEED, 0, o->speed, 0);
+	push_edit(UK_OSET, i, OF_DIR, 0, o->dir, 0);
+	push_edit(UK_OBJ, o->pos.x, o->pos.y, i, 1, 0);
+	remove_obj(i);
 }
 
-static void forw_line(void)
+static void put_obj(const struct object *c, int x, int y)
 {
-	char *line;
+	struct object *o;
+	int i;
+	int n;
 
-	line = next_line(g_lines[2]); 
-	if (line != g_lines[2]) {
-		g_lines[0] = g_lines[1];
-		g_lines[1] = g_lines[2]; 
-		g_lines[2] = line;
-	} else if (!is_single_line()) {
-		g_cursor.y = 16;
+	i = g_map->object_count;
+	push_edit(UK_OBJ, x, y, i, 0, 1);
+	insert_obj(i, x, y);
+	push_edit(UK_OSET, i, OF_DIR, 0, 0, c->dir);
+	push_edit(UK_OSET, i, OF_SPEED, 0, 0, c->speed);
+	push_edit(UK_OSET, i, OF_TILE, 0, 0, c->tile);
+	for (n = 0; c->str[n]; n++) {
+		push_edit(UK_OSET, i, OF_STR, n, 0, c->str[n]);
 	}
 
-	horz_cursor_lim();
-	g_txt_flags |= TF_PLACE;
+	o = g_map->objects + i;
+	o->dir = c->dir;
+	o->speed = c->speed;
+	o->tile = c->tile;
+	strcpy(o->str, c->str);
 }
 
-static void back_line(void)
+static void free_objs_in(ivec4 r)
 {
-	char *line;
+	int i;
 
-	line = prev_line(g_lines[0], g_base); 
-	if (line != g_lines[0]) {
-		g_lines[2] = g_lines[1];
-		g_lines[1] = g_lines[0]; 
-		g_lines[0] = line;
-	} else if (!is_single_line()) {
-		g_cursor.y = 14;
-	}
+	i = g_map->object_count;
+	while (i-- > 0) {
+		struct object *o;
 
-	horz_cursor_lim();
-	g_txt_flags |= TF_PLACE;
+		o = g_map->objects + i;
+		if (in_rect(r, o->pos.x, o->pos.y)) {
+			free_obj(i);
+		}
+	}
 }
 
-static struct v2b cur_pos(void)
+static void cut_sel(void)
 {
-	struct v2b v;
-	v.x = g_cursor.x - 1; 
-	v.y = (g_cursor.y - 14) / 2;
-	return v;
+	ivec4 r;
+
+	copy_sel();
+	get_sel_rect(r);
+	fill_rect(r[0], r[1], r[2], r[3], g_map->def_quad);
+	free_objs_in(r);
 }
 
-static void fix_cursor(const char *s)
+static void put_text(int x, int y, const char *str)
 {
-	if (!is_single_line() && s >= g_lines[1]) {
-		g_cursor.x = s - g_lines[1] + 1;
-		g_cursor.y = 16;
-	} else if (s >= g_lines[0]) {
-		g_cursor.x = s - g_lines[0] + 1;
-		g_cursor.y = 14;
+	struct text *t;
+	int i;
+
+	t = get_text(x, y);
+	if (!t) {
+		return;
+	}
+	for (i = 0; str[i]; i++) {
+		push_edit(UK_INS, x, y, i, 0, str[i]);
 	}
+	strcpy(t->str, str);
 }
 
-static int next_char(void)
+static void paste_sel(void)
 {
-	struct v2b v; 
-	const char *s;
+	uint8_t was[MAX_TEXTS];
+	ivec4 r;
+	int y;
+	int i;
 
-	v = cur_pos();
+	if (!g_clip.w) {
+		return;
+	}
 
-	s = &g_lines[v.y][v.x];
-	if (!*s) {
-		return *s;
-	} 
+	/*
+	 * The clipboard is a copy, so pasting over the source block 
+	 * never reads a row it has already written
+	 */
+	r[0] = g_cam[0] + g_qm_sel.pos.x / 2;
+	r[1] = g_cam[1] + g_qm_sel.pos.y / 2;
+	r[2] = MIN(r[0] + g_clip.w, g_map->width);
+	r[3] = MIN(r[1] + g_clip.h, g_map->height);
+
+	snap_texts(was);
+	undo_begin();
+	for (y = r[1]; y < r[3]; y++) {
+		const uint8_t *src;
+		uint8_t *dst;
+		int x;
 
-	s++;
-	if (s >= g_lines[v.y + 1]) {
-		forw_line();
+		src = g_clip.data[y - r[1]];
+		dst = g_map->data[y] + r[0];
+		for (x = 0; x < r[2] - r[0]; x++) {
+			if (dst[x] != src[x]) {
+				push_edit(UK_QUAD, r[0] + x, y, 0, 
+						dst[x], src[x]);
+			}
+		}
+		memcpy(dst, src, r[2] - r[0]);
 	}
-	fix_cursor(s);
-	g_txt_flags |= TF_PLACE;
-	return *s;
-}
+	free_stale_texts(was);
 
-static const char *prev_char(void)
-{
-	struct v2b v;
-	const char *s;
+	for (i = 0; i < g_clip.text_count; i++) {
+		const struct text *c;
+		struct text *t;
+		int x;
 
-	v = cur_pos();
+		c = g_clip.texts + i;
+		x = r[0] + c->pos.x;
+		y = r[1] + c->pos.y;
+		if (!in_rect(r, x, y)) {
+			continue;
+		}
+		t = find_text(x, y);
+		if (t) {
+			free_text(t);
+		}
+		put_text(x, y, c->str);
+	}
 
-	s = &g_lines[v.y][v.x];
-	if (s == g_base) {
-		return s;
-	} 
+	/*like texts, a pasted object replaces what was there*/
+	free_objs_in(r);
+	for (i = 0; i < g_clip.object_count; i++) {
+		const struct object *c;
+		int x;
 
-	s--;
-	if (s < g_lines[0]) {
-		back_line();
+		c = g_clip.objects + i;
+		x = r[0] + c->pos.x;
+		y = r[1] + c->pos.y;
+		if (g_map->object_count >= MAX_OBJS || !in_rect(r, x, y)) {
+			continue;
+		}
+		put_obj(c, x, y);
 	}
-	fix_cursor(s);
-	g_txt_flags |= TF_PLACE;
-	return s;
-}
 
-static void next_word(void)
-{
-	int ch;
-	do {
-		ch = next_char();
-	} while (ch && !isspace(ch));
-	do {
-		ch = next_char();
-	} while (ch && isspace(ch));
+	if (g_render_path == RP_QUAD) {
+		qm_upload_rows(*g_map->data, r[1], r[3] - r[1]);
+	}
+	restream_rect(r[0], r[1], r[2], r[3]);
 }
 
-static void prev_word(void)
+static void toggle_mark(void)
 {
-	const char *s;
-	do {
-		s = prev_char();
-	} while (s != g_base && isspace(*s));
-	do {
-		s = prev_char();
-	} while (s != g_base && !isspace(*s));
-	if (s != g_base) {
-		next_char();
+	int qx, qy;
+
+	qx = g_cam[0] + g_qm_sel.pos.x / 2;
+	qy = g_cam[1] + g_qm_sel.pos.y / 2;
+	if (g_marked && g_mark.x == qx && g_mark.y == qy) {
+		g_marked = 0;
+		return;
 	}
+
+	show_mark(g_qm_sel.blank);
+	g_mark.x = qx;
+	g_mark.y = qy;
+	g_marked = 1;
 }
 
-static void insert_ch(char *s, int ch) 
+static int ch_to_tile(int ch) 
+{
+	switch(ch) {
+	case ' ':
+		return MT_BLANK;
+	case '0' ... '9':
+		return MT_ZERO + (ch - '0');
+	case ':':
+		return MT_COLON;
+	case 'A' ... 'Z':
+		return MT_CAPITAL_A + (ch - 'A');
+	case 'a' ... 'z':
+		return MT_LOWERCASE_A + (ch - 'a');
+	case '\xE9':
+		return MT_ACCENTED_E;
+	case '!':
+		return MT_EXCLAMATION_POINT;
+	case '\'':
+		return MT_QUOTE_S;
+	case '-':
+		return MT_DASH;
+	case '~':
+		return MT_QUOTE_M;
+	case ',':
+		return MT_COMMA;
+	case '.':
+		return MT_PERIOD;
+	case ';':
+		return MT_SEMI_COLON;
+	case '[':
+		return MT_LEFT_BRACKET;
+	case ']':
+		return MT_RIGHT_BRACKET; 
+	case '(':
+		return MT_LEFT_PARENTHESIS;
+	case ')':
+		return MT_RIGHT_PARENTHESIS;
+	case '^':
+		return MT_MALE_SYMBOL;
+	case '|':
+		return MT_FEMALE_SYMBOL;
+	case '/':
+		return MT_SLASH;
+	case '\1':
+		return MT_PK;
+	case '\2':
+		return MT_MN;
+	case '=':
+		return MT_MIDDLE_SCORE;
+	case '_':
+		return MT_UPPER_SCORE;
+	case '\3':
+		return MT_END;
+	case '*': 
+		return MT_TIMES;
+	case '?':
+		return MT_QUESTION;
+	}
+	return MT_EMPTY;
+}
+
+static void place_text(int x0, int y0, const char *text)
+{
+	const char *t;
+	int x;
+	int y;
+
+	x = x0;
+	y = y0;
+
+	t = text;
+	while (*t) {
+		switch (*t) {
+		case '\n':
+			x = x0; 
+			y += 2;
+			break;
+		default:
+			set_tile(&g_wms, x, y, ch_to_tile(*t));
+			x++;
+		}
+		t++;
+	}
+}
+
+static void place_textf(int x0, int y0, const char *fmt, ...)
+{
+	va_list ap;
+	char buf[360];
+
+	va_start(ap, fmt);
+	vsnprintf(buf, 360, fmt, ap);
+	va_end(ap);
+
+	place_text(x0, y0, buf);
+}
+
+static void place_row(uint8_t *row, int x0, int x1, int l, int c, int r)
+{
+	int iw;
+
+	iw = x1 - x0 - 2;
+	row[x0] = l;
+	memset(row + x0 + 1, c, iw);
+	row[x1 - 1] = r;
+}
+
+static void place_box(int x0, int y0, int x1, int y1)
+{
+	tile_row *row;
+	int n;
+
+	row = g_wms.tm + y0;
+	place_row(*row, x0, x1, MT_TOP_LEFT, MT_MIDDLE, MT_TOP_RIGHT);
+
+	n = y1 - y0 - 2;
+	while (n-- > 0) {
+		row++;
+		place_row(*row, x0, x1, MT_CENTER_LEFT, 
+				MT_BLANK, MT_CENTER_RIGHT);
+	}
+
+	place_row(*row, x0, x1, MT_BOTTOM_LEFT, MT_MIDDLE, MT_BOTTOM_RIGHT);
+	mark_rows(&g_wms, y0, y1 - y0);
+}
+
+static void clear_wm(void)
+{
+	memset(g_wms.tm, 0, sizeof(g_wms.tm));
+	mark_rows(&g_wms, 0, TILE_MAP_LEN);
+}
+
+static void open_edit(void);
+
+static char *g_base;
+static char *g_lines[3];
+static struct v2b g_cursor; 
+static struct v2b g_text_pos;
+
+static int is_sep(int ch)
+{
+	return isspace(ch) || ch == '-'; 
+}
+
+static size_t word_len(const char *str)
+{
+	const char *s;
+
+	s = str;
+	if (is_sep(*s)) {
+		while (*s && is_sep(*s)) {
+			s++;
+		}
+	} else {
+		while (*s && !is_sep(*s)) {
+			s++;
+		}
+	}
+
+	return s - str;
+}
+
+static char *next_line(char *line)
+{
+	char *s;
+	size_t n;
+		
+	s = line;
+	n = 17;
+	while (*s) {
+		char *newline;
+		size_t len;
+
+		/*when newline is not needed but still used*/
+		if (*s == '\n') {
+			s++;
+		}
+
+		len = word_len(s);
+		if (len > 17) {
+			len = 17;
+		}
+
+		if (len > n) {
+			return s;
+		}
+
+		n -= len;
+		
+		newline = memchr(s, '\n', len + 1);
+		if (newline) {
+			return newline + 1;
+		}
+		s += len;
+	}
+	return s;
+}
+
+static size_t word_len_rev(const char *str, const char *base)
+{
+	const char *s;
+
+	s = str;
+	if (is_sep(s[-1])) {
+		while (s > base && is_sep(s[-1])) {
+			s--;
+		}
+	} else {
+		while (s > base && !is_sep(s[-1])) {
+			s--;
+		}
+	}
+	return str - s;
+}
+
+static char *prev_line(char *line, char *base)
+{
+	char *s;
+	size_t n;
+
+	s = line;
+	n = 17;
+
+	while (s > base) {
+		char *newline;
+		size_t len;
+
+		if (s[-1] == '\n') {
+			s--;
+		}
+
+		len = word_len_rev(s, base); 
+		if (len > 17) {
+			len = 17;
+		}
+
+		if (len > n) {
+			return s;
+		}
+
+		n -= len;
+		
+		newline = memchr(s - len - 1, '\n', len + 1);
+		if (newline) {
+			return newline + 1;
+		}
+		s -= len;
+	}
+
+	return s;
+}
+
+static void place_lines(void)
+{
+	int y;
+	char **ps;
+
+	y = 14;
+	ps = g_lines;
+	while (y <= 16) {
+		int x;
+		const char *s, *end;
+
+		/*place text*/
+		x = 1;
+		s = ps[0];
+		end = ps[1];
+		while (s < end && *s != '\n') {
+			if (x == g_cursor.x && y == g_cursor.y) {
+				set_tile(&g_wms, x, y, MT_FULL_HORZ_ARROW); 
+			} else {
+				set_tile(&g_wms, x, y, ch_to_tile(*s));
+				s++;
+			}
+			x++;
+		}
+
+		/*pad text with blank tiles*/
+		for (; x < 19; x++) {
+			if (x == g_cursor.x && y == g_cursor.y) {
+				set_tile(&g_wms, x, y, MT_FULL_HORZ_ARROW); 
+			} else {
+				set_tile(&g_wms, x, y, MT_BLANK);
+			}
+		}
+
+		/*next line*/
+		y += 2;
+		ps++;
+	}
+}
+
+
+static char *cur_lptr(void)
+{
+	return g_lines[(g_cursor.y - 14) / 2];
+}
+
+static char *next_lptr(void)
+{
+	return g_lines[(g_cursor.y - 14) / 2 + 1];
+}
+
+static size_t dif_line(void)
+{
+	return next_lptr() - cur_lptr();
+}
+
+static int is_single_line(void)
+{
+	return g_lines[1] == g_lines[2];
+}
+
+static void horz_cursor_lim(void)
+{
+	size_t dif;
+	dif = dif_line() + 1;
+	g_cursor.x = MIN(g_cursor.x, dif);
+}
+
+static void forw_line(void)
+{
+	char *line;
+
+	line = next_line(g_lines[2]); 
+	if (line != g_lines[2]) {
+		g_lines[0] = g_lines[1];
+		g_lines[1] = g_lines[2]; 
+		g_lines[2] = line;
+	} else if (!is_single_line()) {
+		g_cursor.y = 16;
+	}
+
+	horz_cursor_lim();
+	g_txt_flags |= TF_PLACE;
+}
+
+static void back_line(void)
+{
+	char *line;
+
+	line = prev_line(g_lines[0], g_base); 
+	if (line != g_lines[0]) {
+		g_lines[2] = g_lines[1];
+		g_lines[1] = g_lines[0]; 
+		g_lines[0] = line;
+	} else if (!is_single_line()) {
+		g_cursor.y = 14;
+	}
+
+	horz_cursor_lim();
+	g_txt_flags |= TF_PLACE;
+}
+
+static struct v2b cur_pos(void)
+{
+	struct v2b v;
+	v.x = g_cursor.x - 1; 
+	v.y = (g_cursor.y - 14) / 2;
+	return v;
+}
+
+static void fix_cursor(const char *s)
+{
+	if (!is_single_line() && s >= g_lines[1]) {
+		g_cursor.x = s - g_lines[1] + 1;
+		g_cursor.y = 16;
+	} else if (s >= g_lines[0]) {
+		g_cursor.x = s - g_lines[0] + 1;
+		g_cursor.y = 14;
+	}
+}
+
+static int next_char(void)
+{
+	struct v2b v; 
+	const char *s;
+
+	v = cur_pos();
+
+	s = &g_lines[v.y][v.x];
+	if (!*s) {
+		return *s;
+	} 
+
+	s++;
+	if (s >= g_lines[v.y + 1]) {
+		forw_line();
+	}
+	fix_cursor(s);
+	g_txt_flags |= TF_PLACE;
+	return *s;
+}
+
+static const char *prev_char(void)
+{
+	struct v2b v;
+	const char *s;
+
+	v = cur_pos();
+
+	s = &g_lines[v.y][v.x];
+	if (s == g_base) {
+		return s;
+	} 
+
+	s--;
+	if (s < g_lines[0]) {
+		back_line();
+	}
+	fix_cursor(s);
+	g_txt_flags |= TF_PLACE;
+	return s;
+}
+
+static void next_word(void)
+{
+	int ch;
+	do {
+		ch = next_char();
+	} while (ch && !isspace(ch));
+	do {
+		ch = next_char();
+	} while (ch && isspace(ch));
+}
+
+static void prev_word(void)
+{
+	const char *s;
+	do {
+		s = prev_char();
+	} while (s != g_base && isspace(*s));
+	do {
+		s = prev_char();
+	} while (s != g_base && !isspace(*s));
+	if (s != g_base) {
+		next_char();
+	}
+}
+
+static void insert_ch(char *s, int ch) 
+{
+	do {
+		int tmp;
+		tmp = ch;
+		ch = *s;
+		*s = tmp;
+	} while (*s++);
+}
+
+static void remove_ch(char *s)
+{
+	while ((s[0] = s[1])) {
+		s++;
+	}
+}
+
+static void insert_key(int ch)
+{
+	struct v2b v;
+	char *b;
+	size_t size;
+
+	size = strlen(g_base) + 1; 
+	if (size >= TEXT_SIZE) {
+		return;	
+	}
+
+	v = cur_pos();
+	b = &g_lines[v.y][v.x];
+
+	undo_begin();
+	push_edit(UK_INS, g_text_pos.x, g_text_pos.y, b - g_base, 0, ch);
+	insert_ch(b, ch);
+
+	g_lines[1] = next_line(g_lines[0]);
+	g_lines[2] = next_line(g_lines[1]);
+	next_char();
+	g_txt_flags |= TF_PLACE;
+}
+
+static void remove_key(void)
+{
+	struct v2b v;
+	char *b;
+
+	v = cur_pos();
+	b = &g_lines[v.y][v.x];
+
+	if (b == g_base) {
+		return;
+	}
+
+	undo_begin();
+	push_edit(UK_DEL, g_text_pos.x, g_text_pos.y, 
+			b - 1 - g_base, b[-1], 0);
+	remove_ch(b - 1);
+
+	g_lines[1] = next_line(g_lines[0]);
+	g_lines[2] = next_line(g_lines[1]);
+	prev_char();
+
+	g_txt_flags |= TF_PLACE;
+}
+
+static void quad_key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mods)
+{
+	switch (key) {
+	case GLFW_KEY_ESCAPE:
+		switch (action) {
+		case GLFW_PRESS:
+			clear_wm();
+			open_edit();
+			break;
+		}
+		break;
+	case GLFW_KEY_DOWN:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			forw_line();
+			break;
+		}
+		break;
+	case GLFW_KEY_UP:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			back_line();
+			break;
+		}
+		break;
+	case GLFW_KEY_LEFT:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			if (mods & GLFW_MOD_CONTROL) {
+				prev_word();
+			} else {
+				prev_char();
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_RIGHT:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			if (mods & GLFW_MOD_CONTROL) {
+				next_word();
+			} else {
+				next_char();
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_BACKSPACE:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			remove_key();
+			break;
+		}
+		break;
+	}
+	if (g_txt_flags & TF_PLACE) {
+		place_lines();
+		g_txt_flags = 0;
+	}
+	g_txt_flags = 0;
+}
+
+static void quad_char_forw_cb(GLFWwindow *wnd, unsigned cp)
+{
+	if (cp == '\xE9') {
+		cp = 0;
+	}
+	if (cp == '&') {
+		cp = '\xE9';
+	}
+	if (ch_to_tile(cp)) {
+		insert_key(cp);
+	}
+}
+
+static void quad_char_cb(GLFWwindow *wnd, unsigned cp)
+{
+	g_char_fn = quad_char_forw_cb;
+}
+
+static void key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mods)
+{
+	g_events++;
+	rec_put(IT_KEY, key, scancode, action, mods);
+	if (g_key_fn) {
+		g_key_fn(wnd, key, scancode, action, mods);
+	}
+}
+
+static void char_cb(GLFWwindow *wnd, unsigned cp)
+{
+	g_events++;
+	rec_put(IT_CHAR, cp, 0, 0, 0);
+	if (g_char_fn) {
+		g_char_fn(wnd, cp);
+	}
+}
+
+static void set_state(GLFWkeyfun key, GLFWcharfun ch) 
+{
+	g_key_fn = key;
+	g_char_fn = ch;
+}
+
+static void open_quad(void)
+{
+	int qx, qy;
+
+	qx = g_cam[0] + g_qm_sel.pos.x / 2;
+	qy = g_cam[1] + g_qm_sel.pos.y / 2;
+
+	if (g_qprops[g_map->data[qy][qx]] == QP_MSG) {
+		struct text *t;
+
+		t = get_text(qx, qy);
+		if (!t) {
+			fprintf(stderr, "Too many texts!\n");
+			return;
+		}
+		place_box(0, 12, 20, 19);
+
+		g_text_pos = t->pos;
+		g_base = t->str;
+		g_lines[0] = g_base;
+		g_lines[1] = next_line(g_lines[0]); 
+		g_lines[2] = next_line(g_lines[1]);
+		g_cursor.x = 1;
+		g_cursor.y = 14;
+
+		place_lines();
+		set_state(quad_key_cb, quad_char_cb);
+	}	
+}
+
+static int g_path_i;
+
+static void open_msel(void);
+
+static void path_key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mods)
+{
+	switch (key) {
+	case GLFW_KEY_BACKSPACE:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			if (g_path_i > 0) {
+				char *s;
+				s = g_map->path + --g_path_i;
+				remove_ch(s);
+				g_map->dirty = 1;
+				place_text(3, 15, g_map->path);
+				set_tile(&g_wms, 3 + g_path_i, 15, MT_BLANK);
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_ESCAPE:
+		open_msel();
+		break;
+	}
+}
+static void path_char_forw_cb(GLFWwindow *wnd, unsigned cp)
+{
+	if (g_path_i + 1 < _countof(g_map->path) && cp < 0x80 && isalnum(cp)) {
+		char *b;
+		b = g_map->path + g_path_i++;
+		insert_ch(b, cp);
+		g_map->dirty = 1;
+		place_text(3, 15, g_map->path);
+	}
+}
+
+static void path_char_cb(GLFWwindow *wnd, unsigned cp)
+{
+	g_char_fn = path_char_forw_cb;
+}
+
+static void open_path_sel(void)
+{
+	place_box(1, 14, 19, 18);
+	place_text(3, 15, g_map->path);
+	g_path_i = strlen(g_map->path);
+	set_state(path_key_cb, path_char_cb);
+}
+
+static struct map *recent_map(void)
+{
+	struct map *best;
+	int i;
+
+	best = NULL;
+	for (i = 0; i < g_map_count; i++) {
+		struct map *m;
+
+		m = g_maps[i];
+		if (m != g_map && (!best || m->used > best->used)) {
+			best = m;
+		}
+	}
+	return best;
+}
+
+static char g_open_path[MAX_MAP_PATH];
+static int g_open_i;
+
+/*what the maps directory held when the Open box came up*/
+static char g_map_names[MAX_MAP_NAMES][MAX_MAP_PATH];
+static int g_map_name_count;
+
+static int open_map(const char *path);
+static void prefetch_map(const char *path);
+static void close_msel(void);
+
+static void list_map_names(void)
+{
+	DIR *dir;
+	struct dirent *ent;
+
+	g_map_name_count = 0;
+	dir = opendir("../Poke/Shared/Maps/");
+	if (!dir) {
+		return;
+	}
+	while ((ent = readdir(dir)) && g_map_name_count < MAX_MAP_NAMES) {
+		const char *name;
+
+		name = ent->d_name;
+		if (*name == '.' || strlen(name) >= MAX_MAP_PATH) {
+			continue;
+		}
+		strcpy(g_map_names[g_map_name_count++], name);
+	}
+	closedir(dir);
+}
+
+/*the exact name, else the only name it completes to*/
+static void prefetch_typed(void)
+{
+	const char *only;
+	size_t n;
+	int i, hits;
+
+	if (!g_open_i) {
+		return;
+	}
+	only = NULL;
+	hits = 0;
+	n = g_open_i;
+	for (i = 0; i < g_map_name_count; i++) {
+		const char *name;
+
+		name = g_map_names[i];
+		if (strncmp(name, g_open_path, n) != 0) {
+			continue;
+		}
+		if (!name[n]) {
+			prefetch_map(name);
+			return;
+		}
+		only = name;
+		hits++;
+	}
+	if (hits == 1) {
+		prefetch_map(only);
+	}
+}
+
+static void open_key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mods)
+{
+	switch (key) {
+	case GLFW_KEY_BACKSPACE:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			if (g_open_i > 0) {
+				remove_ch(g_open_path + --g_open_i);
+				place_text(3, 15, g_open_path);
+				set_tile(&g_wms, 3 + g_open_i, 15, MT_BLANK);
+				prefetch_typed();
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_ENTER:
+		if (action != GLFW_PRESS) {
+			break;
+		}
+		if (open_map(g_open_path) < 0) {
+			place_text(3, 17, "No such map");
+		} else {
+			close_msel();
+		}
+		break;
+	case GLFW_KEY_ESCAPE:
+		open_msel();
+		break;
+	}
+}
+
+static void open_char_forw_cb(GLFWwindow *wnd, unsigned cp)
+{
+	if (g_open_i + 1 < _countof(g_open_path) && 
+			cp < 0x80 && isalnum(cp)) {
+		insert_ch(g_open_path + g_open_i++, cp);
+		place_text(3, 15, g_open_path);
+		prefetch_typed();
+	}
+}
+
+static void open_char_cb(GLFWwindow *wnd, unsigned cp)
+{
+	g_char_fn = open_char_forw_cb;
+}
+
+static void open_map_sel(void)
+{
+	struct map *m;
+
+	/*start on the last map left so ENTER flips straight back*/
+	m = recent_map();
+	strcpy(g_open_path, m ? m->path : "");
+	g_open_i = strlen(g_open_path);
+	list_map_names();
+
+	place_box(1, 14, 19, 18);
+	place_text(3, 15, g_open_path);
+	set_state(open_key_cb, open_char_cb);
+}
+
+static void update_place(void)
+{
+	ivec2 off;
+
+	off[0] = (g_qsel.pos.x - 2) / 3;
+	off[1] = (g_qsel.pos.y - 3) / 3; 
+	g_place = g_qsel_page * 20 + off[0] + off[1] * 5; 
+}
+
+static void close_msel(void)
+{	
+	update_place();
+	clear_wm();
+	open_edit();
+}
+
+static void open_qsel(void);
+static int write_map(struct map *m);
+
+static void msel_key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mods)
+{
+	if (action != GLFW_PRESS || move_sel_kb(key, &g_msel)) {
+		return;
+	}
+
+	switch (key) {
+	case GLFW_KEY_X:
+		switch (g_msel.pos.y) {
+		case 3: /*Path*/
+			open_path_sel();
+			break;
+		case 5: /*Open*/
+			open_map_sel();
+			break;
+		case 7: /*Save*/
+			if (write_map(g_map) < 0) {
+				place_text(3, 15, "Save failed");
+			} else {
+				place_text(3, 15, "Saved      ");
+			}
+			break;
+		case 9: /*Quad*/
+			open_qsel();
+			break;
+		}
+		break;
+	case GLFW_KEY_Z:
+		close_msel();
+		break;
+	}
+}
+
+static void open_msel(void)
+{
+	place_box(1, 1, 19, 18);
+	place_text(3, 3, "Path");
+	place_text(3, 5, "Open");
+	place_text(3, 7, "Save");
+	place_text(3, 9, "Quad");
+	place_sel(&g_msel);
+	set_state(msel_key_cb, NULL);
+}
+
+static void bound_qm_sel(void)
+{
+	g_qm_sel.br.x = 2 * MIN(9, g_map->width - g_cam[0] - 1);
+	g_qm_sel.br.y = 2 * MIN(8, g_map->height - g_cam[1] - 1);
+}
+
+static void restream_quad(int qx, int qy)
+{
+	int rx, ry;
+
+	rx = qx - g_cam[0];
+	ry = qy - g_cam[1];
+	if (rx >= -1 && rx <= VIEW_QUADS_X && ry >= -1 && ry <= VIEW_QUADS_Y) {
+		mq_to_t(qx * 2, qy * 2, qx, qy);
+	}
+}
+
+static void restream_quad_id(int d)
+{
+	int rx, ry;
+
+	for (ry = -1; ry <= VIEW_QUADS_Y; ry++) {
+		for (rx = -1; rx <= VIEW_QUADS_X; rx++) {
+			int qx, qy;
+
+			qx = g_cam[0] + rx;
+			qy = g_cam[1] + ry;
+			if ((q_in_bounds(qx, qy) ? g_map->data[qy][qx] : 
+					g_map->def_quad) == d) {
+				restream_quad(qx, qy);
+			}
+		}
+	}
+}
+
+/*quads only grow box, end_recs sends them in one go*/
+static void apply_rec(const struct undo_rec *r, int redo, ivec4 box)
+{
+	struct text *t;
+	int val;
+
+	val = redo ? r->new : r->old;
+	if (r->kind != UK_TILE && r->kind != UK_PROP) {
+		g_map->dirty = 1;
+	}
+	switch (r->kind) {
+	case UK_QUAD:
+		g_map->data[r->y][r->x] = val;
+		box[0] = MIN(box[0], r->x);
+		box[1] = MIN(box[1], r->y);
+		box[2] = MAX(box[2], r->x + 1);
+		box[3] = MAX(box[3], r->y + 1);
+		break;
+	case UK_TILE:
+		set_quad_tile(r->x, r->idx, val);
+		restream_quad_id(r->x);
+		break;
+	case UK_PROP:
+		g_qprops[r->x] = val;
+		break;
+	case UK_INS:
+	case UK_DEL:
+		t = get_text(r->x, r->y);
+		if (!t) {
+			break;
+		}
+		if ((r->kind == UK_INS) == redo) {
+			insert_ch(t->str + r->idx, 
+					r->kind == UK_INS ? r->new : r->old);
+		} else {
+			remove_ch(t->str + r->idx);
+		}
+		break;
+	case UK_OBJ:
+		if (val) {
+			insert_obj(r->idx, r->x, r->y);
+		} else {
+			remove_obj(r->idx);
+		}
+		break;
+	case UK_OSET:
+		set_obj_field(g_map->objects + r->x, r->y, r->idx, val);
+		break;
+	case UK_FREE:
+		if (!redo) {
+			get_text(r->x, r->y);
+		} else if ((t = find_text(r->x, r->y))) {
+			destroy_text(t);
+		}
+		break;
+	}
+}
+
+static void end_recs(const ivec4 box)
+{
+	if (box[0] >= box[2]) {
+		return;
+	}
+	if (g_render_path == RP_QUAD) {
+		qm_upload_rows(*g_map->data, box[1], box[3] - box[1]);
+	}
+	restream_rect(box[0], box[1], box[2], box[3]);
+}
+
+static void undo(void)
+{
+	const struct undo_rec *r;
+	ivec4 box = {g_map->width, g_map->height, 0, 0};
+
+	while ((r = undo_pop())) {
+		apply_rec(r, 0, box);
+		if (!(r->flags & UF_JOIN)) {
+			break;
+		}
+	}
+	end_recs(box);
+}
+
+static void redo(void)
+{
+	const struct undo_rec *r;
+	ivec4 box = {g_map->width, g_map->height, 0, 0};
+
+	r = redo_pop();
+	while (r) {
+		apply_rec(r, 1, box);
+		r = redo_peek();
+		if (!r || !(r->flags & UF_JOIN)) {
+			break;
+		}
+		redo_pop();
+	}
+	end_recs(box);
+}
+
+static void fmt_stat(char *buf, float v)
+{
+	/*always 4 characters wide*/
+	if (v < 9.995F) {
+		sprintf(buf, "%4.2f", v);
+	} else if (v < 99.95F) {
+		sprintf(buf, "%4.1f", v);
+	} else if (v < 9999.5F) {
+		sprintf(buf, "%4.0f", v);
+	} else if (v < 999500.0F) {
+		sprintf(buf, "%3.0fk", v / 1000.0F);
+	} else {
+		strcpy(buf, "many");
+	}
+}
+
+static void place_hud(void)
+{
+	static const char *const names[HS_COUNT] = {
+		"CPU", "MAP", "WIN", "UP ", "TS ", "EV ", "PX "
+	};
+
+
+	int y;
+	int i;
+
+	/*times first, then counts per frame under a header of their own*/
+	place_box(0, 0, HUD_X1, HUD_Y1);
+	place_text(1, 1, "MS  MIN  AVG  P99");
+	y = 2;
+	for (i = 0; i < HS_COUNT; i++) {
+		struct stat_summary s;
+		char min[8];
+		char avg[8];
+		char p99[8];
+
+		if (i == HS_UP) {
+			place_text(1, y++, "NUM MIN  AVG  P99");
+		}
+		stat_sum(&g_hud_stats[i], &s);
+		fmt_stat(min, s.min);
+		fmt_stat(avg, s.avg);
+		fmt_stat(p99, s.p99);
+		place_textf(1, y++, "%s %s %s %s", names[i], min, avg, p99);
+	}
+}
+
+static void toggle_hud(void)
+{
+	g_hud = !g_hud;
+	g_gpu_timing = g_hud;
+	memset(g_hud_stats, 0, sizeof(g_hud_stats));
+	if (!g_hud) {
+		memset(g_wms.tm, 0, HUD_Y1 * sizeof(*g_wms.tm));
+		mark_rows(&g_wms, 0, HUD_Y1);
+		place_sel(&g_qm_sel);
+		show_mark(MT_EMPTY_HORZ_ARROW);
+	}
+	damage();
+}
+
+/*spans still open are written as ending now*/
+static void write_trace(void)
+{
+	if (g_trace_path) {
+		trace_write(g_trace_path);
+	}
+}
+
+static void edit_key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mods)
+{
+	/*everything but the camera works on whole quads*/
+	switch (key) {
+	case GLFW_KEY_RIGHT:
+	case GLFW_KEY_LEFT:
+	case GLFW_KEY_DOWN:
+	case GLFW_KEY_UP:
+		break;
+	default:
+		settle_cam();
+	}
+
+	switch (key) {
+	case GLFW_KEY_X:
+		switch (action) {
+		case GLFW_PRESS:
+			if (mods & GLFW_MOD_CONTROL) {
+				cut_sel();
+			} else {
+				place_quad(0);
+			}
+			break;
+		case GLFW_REPEAT:
+			if (!(mods & GLFW_MOD_CONTROL)) {
+				place_quad(1);
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_C:
+		switch (action) {
+		case GLFW_PRESS:
+			if (mods & GLFW_MOD_CONTROL) {
+				copy_sel();
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_V:
+		switch (action) {
+		case GLFW_PRESS:
+			if (mods & GLFW_MOD_CONTROL) {
+				paste_sel();
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_Z:
+		switch (action) {
+		case GLFW_PRESS:
+			if (mods & GLFW_MOD_CONTROL) {
+				undo();
+			} else {
+				open_quad();
+			}
+			break;
+		case GLFW_REPEAT:
+			if (mods & GLFW_MOD_CONTROL) {
+				undo();
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_Y:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			if (mods & GLFW_MOD_CONTROL) {
+				redo();
+			}
+			break;
+		}
+		break;
+	case GLFW_KEY_ENTER:
+		switch (action) {
+		case GLFW_PRESS:
+			remove_sel(&g_qm_sel);
+			open_msel();
+			break;
+		}
+		break;
+	case GLFW_KEY_F3:
+		switch (action) {
+		case GLFW_PRESS:
+			toggle_hud();
+			break;
+		}
+		break;
+	case GLFW_KEY_F4:
+		switch (action) {
+		case GLFW_PRESS:
+			write_trace();
+			break;
+		}
+		break;
+	case GLFW_KEY_F:
+		switch (action) {
+		case GLFW_PRESS:
+			fill_at_sel(0);
+			break;
+		}
+		break;
+	case GLFW_KEY_R:
+		switch (action) {
+		case GLFW_PRESS:
+			fill_at_sel(1);
+			break;
+		}
+		break;
+	case GLFW_KEY_M:
+		switch (action) {
+		case GLFW_PRESS:
+			toggle_mark();
+			break;
+		}
+		break;
+	case GLFW_KEY_RIGHT:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			step_cam(1, 0);
+			break;
+		}
+		break;
+	case GLFW_KEY_LEFT:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			step_cam(-1, 0);
+			break;
+		}
+		break;
+	case GLFW_KEY_DOWN:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			step_cam(0, 1);
+			break;
+		}
+		break;
+	case GLFW_KEY_UP:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			step_cam(0, -1);
+			break;
+		}
+		break;
+	default:
+		switch (action) {
+		case GLFW_PRESS:
+		case GLFW_REPEAT:
+			bound_qm_sel();
+			move_sel_kb(key, &g_qm_sel);
+			show_mark(MT_EMPTY_HORZ_ARROW);
+			break;
+		}
+	}
+}
+
+static void open_edit(void)
+{
+	place_sel(&g_qm_sel);
+	show_mark(MT_EMPTY_HORZ_ARROW);
+	set_state(edit_key_cb, NULL);
+}
+
+static void get_abs_tpt(struct v2b *out, int rtx, int rty)
+{
+	out->x = (g_tms.scroll.x / 8 + rtx) & 31;
+	out->y = (g_tms.scroll.y / 8 + rty) & 31;
+}
+
+static void wm_q_to_t(int x, int y, int d)
+{
+	int sx;
+	int sy;
+
+	memset(g_wms.tm[y] + x, 0, 2);
+	memset(g_wms.tm[y + 1] + x, 0, 2);
+	mark_rows(&g_wms, y, 2);
+
+	sx = g_tms.scroll.x / 8 + x;
+	sy = g_tms.scroll.y / 8 + y;
+	q_to_t(sx, sy, d);
+}
+
+static void place_t_on_wm(int tx, int ty, int tile)
+{
+	struct v2b av;
+
+	set_tile(&g_wms, tx, ty, MT_EMPTY);
+	get_abs_tpt(&av, tx, ty);
+	set_tile(&g_tms, av.x, av.y, tile);
+}
+
+static void open_qtsel(void);
+static void qtsel_key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mode);
+
+static void edit_quad(void)
+{
+	struct v2b tv;
+	struct v2b qv;
+	int t;
+	uint8_t *q;
+
+	rel_sel(&g_tsel, &tv);
+	rel_sel(&g_qsel, &qv);
+	t = tv.x + tv.y * 8 + g_tsel_page * 24;
+	q = g_quad_data[g_place][qv.y] + qv.x;
+	undo_begin();
+	undo_push(UK_TILE, g_place, 0, qv.y * 2 + qv.x, *q, t);
+	set_quad_tile(g_place, qv.y * 2 + qv.x, t);
+	set_tile(&g_tms, g_qtsel.pos.x + 1, g_qtsel.pos.y, t);
+	set_tile(&g_tms, qv.x + 3, qv.y + 3, t);
+}
+
+static void mod_tsel(void)
+{
+	int tx, ty;
+	int t;
+	int n;
+
+	t = g_tsel_page * 24;
+	ty = 5;
+
+	n = 32;
+	while (n-- > 0) {
+		struct v2b av;
+
+		if (t % 8 == 0) {
+			tx = 3;
+			ty += 2;
+		}
+
+		get_abs_tpt(&av, tx, ty);
+
+		set_tile(&g_wms, tx, ty, MT_EMPTY);
+		set_tile(&g_tms, av.x, av.y, t++);
+
+		tx += 2;
+	}
+	place_textf(15, 15, "%d/3", g_tsel_page + 1);
+}
+
+static void place_prop(void)
+{
+	int prop;
+	const char *str;
+
+	prop = g_qprops[g_place];
+	if (prop < _countof(g_prop_strs)) {
+		str = g_prop_strs[prop];	
+	} else {
+		str = "TBD  ";
+	}
+	place_textf(6, 3, "%s\n%3d", str, prop);
+}
+
+static void mod_prop(int off)
+{
+	int old;
+
+	old = g_qprops[g_place];
+	g_qprops[g_place] += off;
+
+	undo_begin();
+	undo_push(UK_PROP, g_place, 0, 0, old, g_qprops[g_place]);
+
+	if (old == QP_MSG) {
+		struct text *t; 
+	
+		t = g_map->texts;
+		while (t < g_map->texts + g_map->text_count) {
+			int q;
+
+			q = g_map->data[t->pos.y][t->pos.x];		
+			if (q == g_place) {
+				/*the last text is moved into t*/
+				free_text(t);
+			} else {
+				t++;
+			}
+		}
+	}
+}
+
+static void change_prop(int off)
+{
+	mod_prop(off);
+	place_prop();
+}
+
+static void tsel_key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mode)
+{
+	if (action == GLFW_PRESS && !move_sel_kb(key, &g_tsel)) { 
+		switch (key) {
+		case GLFW_KEY_X:
+			edit_quad();
+			break;
+		case GLFW_KEY_Z:
+			set_state(qtsel_key_cb, NULL); 
+			break;
+		case GLFW_KEY_RIGHT:
+			g_tsel_page = wrap(g_tsel_page + 1, 0, 2);
+			mod_tsel();
+			break;
+		case GLFW_KEY_LEFT:
+			g_tsel_page = wrap(g_tsel_page - 1, 0, 2);
+			mod_tsel();
+			break;
+		}
+	}
+}
+
+static void open_tsel(void)
 {
-	do {
-		int tmp;
-		tmp = ch;
-		ch = *s;
-		*s = tmp;
-	} while (*s++);
+	set_state(tsel_key_cb, NULL); 
+}
+
+static void qtsel_key_cb(GLFWwindow *wnd, int key, 
+		int scancode, int action, int mode)
+{
+	if (action == GLFW_PRESS && !move_sel_kb(key, &g_qtsel)) { 
+		switch (key) {
+		case GLFW_KEY_X:
+			open_tsel();
+			break;
+		case GLFW_KEY_Z:
+			open_qsel();
+			break;
+		case GLFW_KEY_UP:
+			change_prop(-1);
+			break;
+		case GLFW_KEY_DOWN:
+			change_prop(1);
+			break;
+		}
+	}
+}
+
+static void open_qtsel(void)
+{
+	uint8_t (*q)[2];
+ 
+	place_box(1, 1, 19, 18); 
+
+	wm_q_to_t(3, 3, g_place);
+
+	q = g_quad_data[g_place];
+	place_t_on_wm(14, 3, q[0][0]); 
+	place_t_on_wm(16, 3, q[0][1]); 
+	place_t_on_wm(14, 5, q[1][0]); 
+	place_t_on_wm(16, 5, q[1][1]); 
+
+	g_qtsel.pos.x = 13;
+	g_qtsel.pos.y = 3;
+	place_sel(&g_qtsel);
+
+	g_tsel.pos.x = 2;
+	g_tsel.pos.y = 7;
+	g_tsel_page = 0;
+	place_sel(&g_tsel);
+
+	place_prop();	
+
+	mod_tsel();
+	set_state(qtsel_key_cb, NULL); 
+}
+
+static void mod_qsel(void)
+{
+	int x;
+	int y;
+	int t;
+
+	x = 3;
+	y = 3;
+	t = 0;
+
+	while (t < 20) {
+		wm_q_to_t(x, y, t + g_qsel_page * 20); 
+		if (x < 15) {
+			x += 3;
+		} else {
+			x = 3;
+			y += 3;
+		}
+		t++;
+	}
+	place_textf(15, 15, "%d/6", g_qsel_page + 1);
+}
+
+static void tm_to_qm_screen(void)
+{
+	ivec4 cam_rc;
+	ivec2 scroll;
+
+	scroll[0] = (g_cam[0] - 1) * 2;
+	scroll[1] = (g_cam[1] - 1) * 2;
+	cam_rc[0] = g_cam[0] - 1;
+	cam_rc[1] = g_cam[1] - 1;
+	cam_rc[2] = g_cam[0] + VIEW_QUADS_X + 1;
+	cam_rc[3] = g_cam[1] + VIEW_QUADS_Y + 1;
+	qm_to_tm(scroll, cam_rc);
+}
+
+static void use_tm_view(void)
+{
+	if (g_qms.active) {
+		g_qms.active = 0;
+		tm_to_qm_screen();
+		damage();
+	}
+}
+
+static void use_qm_view(void)
+{
+	if (g_render_path == RP_QUAD) {
+		g_qms.active = 1;
+		damage();
+	}
+}
+
+static void close_qsel(void)
+{
+	use_qm_view();
+	tm_to_qm_screen();
+	open_msel();
+}
+
+static void qsel_key_cb(GLFWwindow *wnd, int key,
+		int scancode, int action, int mode)
+{
+
+	if (action == GLFW_PRESS && !move_sel_kb(key, &g_qsel)) {
+		switch (key) {
+		case GLFW_KEY_X: 
+			update_place();
+			open_qtsel();
+			break;
+		case GLFW_KEY_Z:
+			close_qsel();
+			break;
+		case GLFW_KEY_RIGHT:
+			g_qsel_page = wrap(g_qsel_page + 1, 0, 5);
+			mod_qsel();
+			break;
+		case GLFW_KEY_LEFT:
+			g_qsel_page = wrap(g_qsel_page - 1, 0, 5);
+			mod_qsel();
+			break;
+		}
+	}
+}
+
+static void open_qsel(void)
+{
+	use_tm_view();
+	place_box(1, 1, 19, 18);
+	place_sel(&g_qsel);
+	mod_qsel();
+	set_state(qsel_key_cb, NULL);
+}
+
+static void init_glfw(void) 
+{
+	int w, h;
+
+	glfwSetErrorCallback(error_cb);
+	glfwInit();
+	atexit(glfwTerminate);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, !g_replaying);
+
+	g_wnd = glfwCreateWindow(WND_WIDTH, WND_HEIGHT, 
+			"poke_editor", NULL, NULL);
+	glfwMakeContextCurrent(g_wnd);
+	glfwSwapInterval(1);
+
+	glfwSetInputMode(g_wnd, GLFW_LOCK_KEY_MODS, GLFW_TRUE);
+	glfwSetFramebufferSizeCallback(g_wnd, resize_cb);
+	glfwSetWindowRefreshCallback(g_wnd, refresh_cb);
+	glfwSetKeyCallback(g_wnd, key_cb);
+	glfwSetCharCallback(g_wnd, char_cb);
+
+	if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+		fprintf(stderr, "glad error\n");
+		exit(1);
+	}
+
+	glfwGetFramebufferSize(g_wnd, &w, &h);
+	resize_cb(g_wnd, w, h);
+}
+
+static int hud_shown(void)
+{
+	return g_hud && g_key_fn == edit_key_cb;
+}
+
+static void sample_frame(double cpu)
+{
+	if (g_hud) {
+		stat_push(&g_hud_stats[HS_CPU], cpu * 1000.0);
+		stat_push(&g_hud_stats[HS_MAP], g_gpu_time[TL_MAP]);
+		stat_push(&g_hud_stats[HS_WIN], g_gpu_time[TL_WIN]);
+		stat_push(&g_hud_stats[HS_UP], g_upload_bytes);
+		stat_push(&g_hud_stats[HS_TS], g_restreamed);
+		stat_push(&g_hud_stats[HS_EV], g_events);
+		stat_push(&g_hud_stats[HS_PX], g_scrolled);
+	}
+	g_scrolled_total += g_scrolled;
+	g_restreamed = 0;
+	g_events = 0;
+	g_scrolled = 0;
+	g_upload_bytes = 0;
+}
+
+static void print_frame_stats(void)
+{
+	unsigned long wakes;
+	double up;
+
+	printf("startup: %.2f ms, assets %.2f ms "
+			"(%d stamp hits, %d hash hits, %d decoded)\n", 
+			g_startup_time * 1000.0, g_cache_stats.time * 1000.0, 
+			g_cache_stats.stat_hits, g_cache_stats.hash_hits,
+			g_cache_stats.misses);
+	printf("startup: %d programs from binary cache, %d compiled\n",
+			g_cache_stats.prog_hits, g_cache_stats.prog_misses);
+
+	wakes = g_frames_drawn + g_frames_idle;
+	up = glfwGetTime();
+	printf("frames: %lu drawn, %lu of %lu wake-ups idle (%.1f%%)\n", 
+			g_frames_drawn, g_frames_idle, wakes, 
+			wakes ? 100.0 * g_frames_idle / wakes : 0.0);
+	printf("frames: %.3f s in render() of %.3f s up (%.2f%%)\n", 
+			g_render_time, up, 
+			up > 0.0 ? 100.0 * g_render_time / up : 0.0);
+	printf("scroll: %lu px, %lu quad lines streamed in %.3f ms "
+			"(%.2f us per line)\n", 
+			g_scrolled_total, g_stream_lines, 
+			g_stream_time * 1000.0, g_stream_lines ? 
+			g_stream_time * 1e6 / g_stream_lines : 0.0);
+	printf("maps: %lu opens in memory, %lu waited on the loader, "
+			"%lu read from disk, %lu prefetched\n", 
+			g_map_hits, g_map_waits, g_map_misses, g_prefetched);
+}
+
+static void fread_all_obj(const char *path, void *buf, size_t size)
+{
+	FILE *f;
+
+	f = xfopen(path, "rb");
+	xfread_obj(f, buf, size); 
+	fclose(f);
+}
+
+static void cd_parent(char *path)
+{
+	char *find;
+
+	find = strrchr(path, PATH_SEP);
+	if (find) {
+		*find = '\0';
+	}
+}
+
+#ifdef _WIN32
+static void set_default_directory(void)
+{
+	char path[MAX_PATH];
+
+	GetModuleFileName(NULL, path, MAX_PATH);
+	cd_parent(path);
+	cd_parent(path);
+	SetCurrentDirectory(path);
+}
+
+static char *abs_path(const char *path)
+{
+	char *full;
+
+	full = _fullpath(NULL, path, 0);
+	return full ? full : xstrdup(path);
+}
+#else
+static void set_default_directory(void)
+{
+	char path[MAX_PATH];
+	ssize_t len;
+
+	len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (len < 0) {
+		fprintf(stderr, "editor: cannot find executable, "
+				"staying in the working directory\n");
+		return;
+	}
+	path[len] = '\0';
+	cd_parent(path);
+	cd_parent(path);
+	if (chdir(path) < 0) {
+		fprintf(stderr, "editor: cannot enter \"%s\"\n", path);
+	}
+}
+
+/*unlike realpath, this also takes files that do not exist yet*/
+static char *abs_path(const char *path)
+{
+	char cwd[MAX_PATH];
+	char *full;
+
+	if (*path == '/' || !getcwd(cwd, sizeof(cwd))) {
+		return xstrdup(path);
+	}
+	full = xmalloc(strlen(cwd) + strlen(path) + 2);
+	sprintf(full, "%s/%s", cwd, path);
+	return full;
+}
+#endif
+
+static void fix_path(const char **path)
+{
+	if (*path) {
+		*path = abs_path(*path);
+	}
+}
+
+static int read_pstr(struct span *s, char *str, int n)
+{
+	int len;
+
+	len = span_getc(s);
+	if (len < 0) {
+		return -1;
+	}
+	if (n <= len) {
+		fprintf(stderr, "map: too long of pstr\n");
+		return -1;
+	}
+	if (span_read(s, str, len) < 0) {
+		return -1;
+	}
+	str[len] = '\0';
+	return 0;
+}
+
+static int skip_pstr(struct span *s)
+{
+	int len;
+
+	len = span_getc(s);
+	if (len < 0) {
+		return -1;
+	}
+	return span_skip(s, len);
 }
 
-static void remove_ch(char *s)
-{
-	while ((s[0] = s[1])) {
-		s++;
+static int read_texts(struct span *s, struct map *m)
+{
+	struct text *t;
+	int n;
+
+	m->text_count = 0;
+
+	t = m->texts; 
+	n = span_getc(s);
+	if (n < 0) {
+		return -1;
+	}
+	
+	if (n > MAX_TEXTS) {
+		fprintf(stderr, "map: too many texts\n");
+		return -1;
+	}
+
+	while (n--) {
+		int x, y;
+
+		x = span_getc(s);
+		y = span_getc(s);
+		if (y < 0) {
+			return -1;
+		}
+
+		/*
+		 * Rows past the height were never allocated. Texts on other 
+		 * quads than QP_MSG go later, in drop_stray_texts
+		 */
+		if (y >= m->height) {
+			if (skip_pstr(s) < 0) {
+				return -1;
+			}
+			continue;
+		}
+
+		t->pos.x = x;
+		t->pos.y = y;
+		if (read_pstr(s, t->str, TEXT_SIZE) < 0) {
+			return -1;
+		}
+		m->text_count++;
+		t++;
 	}
+	return 0;
 }
 
-static void insert_key(int ch)
+/*parse_map may run on the loader thread, which must not read g_qprops*/
+static void drop_stray_texts(struct map *m)
 {
-	struct v2b v;
-	char *b;
-	size_t size;
+	struct text *t;
+	int n;
+	int i;
 
-	size = strlen(g_base) + 1; 
-	if (size >= TEXT_SIZE) {
-		return;	
+	n = 0;
+	for (i = 0; i < m->text_count; i++) {
+		t = m->texts + i;
+		if (g_qprops[m->data[t->pos.y][t->pos.x]] == QP_MSG) {
+			m->texts[n++] = *t;
+		}
 	}
-
-	v = cur_pos();
-	b = &g_lines[v.y][v.x];
-
-	insert_ch(b, ch);
-
-	g_lines[1] = next_line(g_lines[0]);
-	g_lines[2] = next_line(g_lines[1]);
-	next_char();
-	g_txt_flags |= TF_PLACE;
+	m->text_count = n;
 }
 
-static void remove_key(void)
+static int read_objects(struct span *s, struct map *m)
 {
-	struct v2b v;
-	char *b;
+	struct object *o;
+	uint8_t hdr[5];
+	int n;
 
-	v = cur_pos();
-	b = &g_lines[v.y][v.x];
+	m->object_count = 0;
 
-	if (b == g_base) {
-		return;
+	/*older maps end after the texts*/
+	if (span_left(s) == 0) {
+		return 0;
 	}
 
-	remove_ch(b - 1);
-
-	g_lines[1] = next_line(g_lines[0]);
-	g_lines[2] = next_line(g_lines[1]);
-	prev_char();
+	o = m->objects;
+	n = span_getc(s);
 
-	g_txt_flags |= TF_PLACE;
-}
+	if (n > MAX_OBJS) {
+		fprintf(stderr, "map: too many objects\n");
+		return -1;
+	}
 
-static void quad_key_cb(GLFWwindow *wnd, int key, 
-		int scancode, int action, int mods)
-{
-	switch (key) {
-	case GLFW_KEY_ESCAPE:
-		switch (action) {
-		case GLFW_PRESS:
-			clear_wm();
-			open_edit();
-			break;
-		}
-		break;
-	case GLFW_KEY_DOWN:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			forw_line();
-			break;
-		}
-		break;
-	case GLFW_KEY_UP:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			back_line();
-			break;
-		}
-		break;
-	case GLFW_KEY_LEFT:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			if (mods & GLFW_MOD_CONTROL) {
-				prev_word();
-			} else {
-				prev_char();
-			}
-			break;
-		}
-		break;
-	case GLFW_KEY_RIGHT:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			if (mods & GLFW_MOD_CONTROL) {
-				next_word();
-			} else {
-				next_char();
-			}
-			break;
+	while (n--) {
+		if (span_read(s, hdr, sizeof(hdr)) < 0) {
+			return -1;
 		}
-		break;
-	case GLFW_KEY_BACKSPACE:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			remove_key();
-			break;
+		o->pos.x = hdr[0];
+		o->pos.y = hdr[1];
+		o->dir = hdr[2];
+		o->speed = hdr[3];
+		o->tile = hdr[4];
+		if (read_pstr(s, o->str, TEXT_SIZE) < 0) {
+			return -1;
 		}
-		break;
-	}
-	if (g_txt_flags & TF_PLACE) {
-		place_lines();
-		g_txt_flags = 0;
+		m->object_count++;
+		o++;
 	}
-	g_txt_flags = 0;
+	return 0;
 }
 
-static void quad_char_forw_cb(GLFWwindow *wnd, unsigned cp)
+static char *strccpy(char *dst, const char *src)
 {
-	if (cp == '\xE9') {
-		cp = 0;
+	while ((*dst++ = *src++));
+	return dst - 1;
+}
+
+static int parse_map(struct span *s, struct map *m)
+{
+	int w, h;
+
+	w = span_getc(s);
+	h = span_getc(s);
+	if (h < 0) {
+		return -1;
 	}
-	if (cp == '&') {
-		cp = '\xE9';
+
+	m->width = w + 1;
+	m->height = h + 1;
+	m->data = xrealloc(m->data, m->height * sizeof(*m->data));
+	memset(m->data, 0, m->height * sizeof(*m->data));
+	
+	if (decomp_quads(s, *m->data, sizeof(*m->data), 
+				m->width, m->height) < 0) {
+		return -1;
 	}
-	if (ch_to_tile(cp)) {
-		insert_key(cp);
+	m->def_quad = span_getc(s);
+	if (m->def_quad < 0) {
+		return -1;
 	}
+	if (read_texts(s, m) < 0) {
+		return -1;
+	}
+	return read_objects(s, m);
 }
 
-static void quad_char_cb(GLFWwindow *wnd, unsigned cp)
+static void map_path(char *full, const char *path)
 {
-	glfwSetCharCallback(g_wnd, quad_char_forw_cb);
+	char *e;
+
+	e = strccpy(full, "../Poke/Shared/Maps/");
+	strcpy(e, path);
 }
 
-static void set_state(GLFWkeyfun key, GLFWcharfun ch) 
+static void clear_map(struct map *m)
 {
-	glfwSetKeyCallback(g_wnd, key);
-	glfwSetCharCallback(g_wnd, ch);
+	m->width = 1;
+	m->height = 1;
+	m->data = xrealloc(m->data, sizeof(*m->data));
+	memset(m->data, 0, sizeof(*m->data));
+	m->def_quad = 0;
+	m->text_count = 0;
+	m->object_count = 0;
 }
 
-static void open_quad(void)
+static struct map *new_map(const char *path)
 {
-	int qx, qy;
+	struct map *m;
 
-	qx = g_cam[0] + g_qm_sel.pos.x / 2;
-	qy = g_cam[1] + g_qm_sel.pos.y / 2;
-
-	if (g_qprops[g_qm_data[qy][qx]] == QP_MSG) {
-		struct text *t;
-
-		t = get_text(qx, qy);
-		if (!t) {
-			fprintf(stderr, "Too many texts!\n");
-			return;
-		}
-		place_box(0, 12, 20, 19);
+	m = xmalloc(sizeof(*m));
+	memset(m, 0, sizeof(*m));
+	strcpy(m->path, path);
+	clear_map(m);
+	return m;
+}
 
-		g_base = t->str;
-		g_lines[0] = g_base;
-		g_lines[1] = next_line(g_lines[0]); 
-		g_lines[2] = next_line(g_lines[1]);
-		g_cursor.x = 1;
-		g_cursor.y = 14;
+static void free_map(struct map *m)
+{
+	free(m->data);
+	free(m);
+}
 
-		place_lines();
-		set_state(quad_key_cb, quad_char_cb);
-	}	
+static size_t map_size(const struct map *m)
+{
+	return sizeof(*m) + m->height * sizeof(*m->data);
 }
 
-static int g_path_i;
+static int read_map(struct map *m, const char *path)
+{
+	struct span s;
+	char full[MAX_PATH];
+	int res;
 
-static void open_msel(void);
+	map_path(full, path);
 
-static void path_key_cb(GLFWwindow *wnd, int key, 
-		int scancode, int action, int mods)
-{
-	switch (key) {
-	case GLFW_KEY_BACKSPACE:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			if (g_path_i > 0) {
-				char *s;
-				s = g_path + --g_path_i;
-				remove_ch(s);
-				place_text(3, 15, g_path);
-				g_wms.tm[15][3 + g_path_i] = MT_BLANK;
-			}
-			break;
-		}
-		break;
-	case GLFW_KEY_ESCAPE:
-		open_msel();
-		break;
+	if (span_read_file(&s, full) < 0) {
+		fprintf(stderr, "map: cannot find map\n");
+		return -1;
+	}
+
+	res = parse_map(&s, m);
+	if (res < 0) {
+		fprintf(stderr, "map: \"%s\" is truncated or corrupt\n", path);
+		clear_map(m);
 	}
+	drop_stray_texts(m);
+
+	span_free(&s);
+	return res;
 }
-static void path_char_forw_cb(GLFWwindow *wnd, unsigned cp)
+
+/*the loader thread's half of read_map, quiet since most loads are guesses*/
+static void *decode_map(const char *path)
 {
-	if (g_path_i + 1 < _countof(g_path) && cp < 0x80 && isalnum(cp)) {
-		char *b;
-		b = g_path + g_path_i++;
-		insert_ch(b, cp);
-		place_text(3, 15, g_path);
+	struct span s;
+	struct map *m;
+	char full[MAX_PATH];
+
+	map_path(full, path);
+	if (span_read_file(&s, full) < 0) {
+		return NULL;
+	}
+
+	m = new_map(path);
+	if (parse_map(&s, m) < 0) {
+		free_map(m);
+		m = NULL;
 	}
+	span_free(&s);
+	return m;
 }
 
-static void path_char_cb(GLFWwindow *wnd, unsigned cp)
+static uint8_t *put_pstr(uint8_t *p, const char *str)
 {
-	glfwSetCharCallback(g_wnd, path_char_forw_cb);
+	size_t len;
+
+	len = strlen(str);
+	*p++ = len;
+	memcpy(p, str, len);
+	return p + len;
 }
 
-static void open_path_sel(void)
+static size_t comp_map(const struct map *m, uint8_t *buf)
 {
-	place_box(1, 14, 19, 18);
-	place_text(3, 15, g_path);
-	g_path_i = strlen(g_path);
-	set_state(path_key_cb, path_char_cb);
+	uint8_t *p;
+	uint8_t *np;
+	const struct text *t;
+	const struct object *o;
+	int n;
+
+	p = buf;
+	*p++ = m->width - 1;
+	*p++ = m->height - 1;
+	p += comp_quads(p, *m->data, sizeof(*m->data), 
+			m->width, m->height);
+	*p++ = m->def_quad;
+
+	/*empty texts are never read back, so drop them*/
+	np = p++;
+	*np = 0;
+	t = m->texts;
+	n = m->text_count;
+	while (n--) {
+		if (*t->str) {
+			*p++ = t->pos.x;
+			*p++ = t->pos.y;
+			p = put_pstr(p, t->str);
+			(*np)++;
+		}
+		t++;
+	}
+
+	*p++ = m->object_count;
+	o = m->objects;
+	n = m->object_count;
+	while (n--) {
+		*p++ = o->pos.x;
+		*p++ = o->pos.y;
+		*p++ = o->dir;
+		*p++ = o->speed;
+		*p++ = o->tile;
+		p = put_pstr(p, o->str);
+		o++;
+	}
+
+	return p - buf;
 }
 
-static void update_place(void)
+static int verify_map(const struct map *m, uint8_t *buf, size_t size)
 {
-	ivec2 off;
+	static map_row qm[256];
 
-	off[0] = (g_qsel.pos.x - 2) / 3;
-	off[1] = (g_qsel.pos.y - 3) / 3; 
-	g_place = g_qsel_page * 20 + off[0] + off[1] * 5; 
-}
+	struct span s;
+	int w, h;
+	int y;
 
-static void close_msel(void)
-{	
-	update_place();
-	clear_wm();
-	open_edit();
-}
+	s.data = buf;
+	s.len = size;
+	s.pos = 0;
 
-static void open_qsel(void);
+	w = span_getc(&s) + 1;
+	h = span_getc(&s) + 1;
+	if (w != m->width || h != m->height) {
+		return -1;
+	}
 
-static void msel_key_cb(GLFWwindow *wnd, int key, 
-		int scancode, int action, int mods)
-{
-	if (action != GLFW_PRESS || move_sel_kb(key, &g_msel)) {
-		return;
+	if (decomp_quads(&s, *qm, sizeof(*qm), w, h) < 0) {
+		return -1;
 	}
 
-	switch (key) {
-	case GLFW_KEY_X:
-		switch (g_msel.pos.y) {
-		case 3: /*Path*/
-			open_path_sel();
-			break;
-		case 5: /*Open*/
-				
-			break;
-		case 7: /*Save*/
-			break;
-		case 9: /*Quad*/
-			open_qsel();
-			break;
+	for (y = 0; y < h; y++) {
+		if (memcmp(qm[y], m->data[y], w) != 0) {
+			return -1;
 		}
-		break;
-	case GLFW_KEY_Z:
-		close_msel();
-		break;
 	}
+
+	return span_getc(&s) == m->def_quad ? 0 : -1;
 }
 
-static void open_msel(void)
+static uint64_t state_hash(void)
 {
-	place_box(1, 1, 19, 18);
-	place_text(3, 3, "Path");
-	place_text(3, 5, "Open");
-	place_text(3, 7, "Save");
-	place_text(3, 9, "Quad");
-	place_sel(&g_msel);
-	set_state(msel_key_cb, NULL);
+	uint8_t *buf;
+	size_t size;
+	uint64_t h;
+
+	buf = xmalloc(MAX_MAP_FILE);
+	size = comp_map(g_map, buf);
+	h = hash_bytes(buf, size, HASH_SEED);
+	h = hash_bytes(g_quad_data, sizeof(g_quad_data), h);
+	h = hash_bytes(g_qprops, sizeof(g_qprops), h);
+	free(buf);
+	return h;
 }
 
-static void bound_qm_sel(void)
+static int write_map(struct map *m)
 {
-	g_qm_sel.br.x = 2 * MIN(9, g_qm_width - g_cam[0] - 1);
-	g_qm_sel.br.y = 2 * MIN(8, g_qm_height - g_cam[1] - 1);
+	uint8_t *buf;
+	size_t size;
+	char full[MAX_PATH];
+	FILE *f;
+	int res;
+
+	buf = xmalloc(MAX_MAP_FILE);
+	size = comp_map(m, buf);
+
+	res = verify_map(m, buf, size);
+	if (res < 0) {
+		fprintf(stderr, "map: \"%s\" failed verification\n", m->path);
+		goto end;
+	}
+
+	/*a replayed session must not touch the maps on disk*/
+	if (g_replaying) {
+		goto end;
+	}
+
+	map_path(full, m->path);
+	f = fopen(full, "wb");
+	if (!f) {
+		fprintf(stderr, "map: cannot write \"%s\"\n", m->path);
+		res = -1;
+		goto end;
+	}
+	if (fwrite(buf, 1, size, f) != size) {
+		fprintf(stderr, "map: short write to \"%s\"\n", m->path);
+		res = -1;
+	}
+	fclose(f);
+	if (res == 0) {
+		m->dirty = 0;
+	}
+end:
+	free(buf);
+	return res;
 }
 
-static void edit_key_cb(GLFWwindow *wnd, int key, 
-		int scancode, int action, int mods)
+static int verify_all_maps(void)
 {
-	switch (key) {
-	case GLFW_KEY_X:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			place_quad();
-			break;
-		}
-		break;
-	case GLFW_KEY_Z:
-		switch (action) {
-		case GLFW_PRESS:
-			open_quad();
-			break;
-		}
-		break;
-	case GLFW_KEY_ENTER:
-		switch (action) {
-		case GLFW_PRESS:
-			remove_sel(&g_qm_sel);
-			open_msel();
-			break;
-		}
-		break;
-	case GLFW_KEY_RIGHT:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			move_cam_right();
-			break;
-		}
-		break;
-	case GLFW_KEY_LEFT:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			move_cam_left();
-			break;
-		}
-		break;
-	case GLFW_KEY_DOWN:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			move_cam_down();
-			break;
+	DIR *dir;
+	struct dirent *ent;
+	uint8_t *buf;
+	int fails;
+
+	dir = opendir("../Poke/Shared/Maps/");
+	if (!dir) {
+		fprintf(stderr, "verify: cannot open maps directory\n");
+		return 1;
+	}
+
+	buf = xmalloc(MAX_MAP_FILE);
+	fails = 0;
+	while ((ent = readdir(dir))) {
+		const char *name;
+		struct map *m;
+		size_t size;
+		int res;
+
+		name = ent->d_name;
+		if (*name == '.' || strlen(name) >= MAX_MAP_PATH) {
+			continue;
 		}
-		break;
-	case GLFW_KEY_UP:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			move_cam_up();
-			break;
+
+		m = new_map(name);
+		res = read_map(m, name);
+		if (res == 0) {
+			size = comp_map(m, buf);
+			res = verify_map(m, buf, size);
 		}
-		break;
-	default:
-		switch (action) {
-		case GLFW_PRESS:
-		case GLFW_REPEAT:
-			bound_qm_sel();
-			move_sel_kb(key, &g_qm_sel);
-			break;
+		free_map(m);
+		if (res < 0) {
+			fails++;
 		}
+		printf("%-16s %s\n", name, res < 0 ? "FAIL" : "ok");
 	}
-}
+	free(buf);
+	closedir(dir);
 
-static void open_edit(void)
-{
-	g_wms.tm[g_qm_sel.pos.y][g_qm_sel.pos.x] = MT_FULL_HORZ_ARROW;
-	set_state(edit_key_cb, NULL);
+	printf("%d failed\n", fails);
+	return fails > 0;
 }
 
-static void get_abs_tpt(struct v2b *out, int rtx, int rty)
+static void upload_map(void)
 {
-	out->x = g_tms.scroll.x / 8 + rtx;
-	out->y = g_tms.scroll.y / 8 + rty;
+	g_qms.size[0] = g_map->width;
+	g_qms.size[1] = g_map->height;
+	g_qms.def_quad = g_map->def_quad;
+	qm_upload_rows(*g_map->data, 0, g_map->height);
 }
 
-static void wm_q_to_t(int x, int y, int d)
+static struct map *find_map(const char *path)
 {
-	int sx;
-	int sy;
+	int i;
 
-	memset(g_wms.tm[y] + x, 0, 2);
-	memset(g_wms.tm[y + 1] + x, 0, 2);
-
-	sx = g_tms.scroll.x / 8 + x;
-	sy = g_tms.scroll.y / 8 + y;
-	q_to_t(sx, sy, d);
+	for (i = 0; i < g_map_count; i++) {
+		if (strcmp(g_maps[i]->path, path) == 0) {
+			return g_maps[i];
+		}
+	}
+	return NULL;
 }
 
-static void place_t_on_wm(int tx, int ty, int tile)
+/*the open map and unsaved ones are never evicted*/
+static void evict_maps(size_t need)
 {
-	struct v2b av;
+	while (g_maps_size + need > MAP_BUDGET || g_map_count == MAX_MAPS) {
+		struct map *m;
+		int lru;
+		int i;
+
+		lru = -1;
+		for (i = 0; i < g_map_count; i++) {
+			m = g_maps[i];
+			if (m == g_map || m->dirty) {
+				continue;
+			}
+			if (lru < 0 || m->used < g_maps[lru]->used) {
+				lru = i;
+			}
+		}
+		if (lru < 0) {
+			return;
+		}
 
-	g_wms.tm[ty][tx] = MT_EMPTY;
-	get_abs_tpt(&av, tx, ty);
-	g_tms.tm[av.y][av.x] = tile;
+		m = g_maps[lru];
+		g_maps_size -= map_size(m);
+		free_map(m);
+		g_maps[lru] = g_maps[--g_map_count];
+	}
 }
 
-static void open_qtsel(void);
-static void qtsel_key_cb(GLFWwindow *wnd, int key, 
-		int scancode, int action, int mode);
+static int add_map(struct map *m)
+{
+	evict_maps(map_size(m));
+	if (g_map_count == MAX_MAPS) {
+		fprintf(stderr, "map: too many unsaved maps\n");
+		return -1;
+	}
+	g_maps[g_map_count++] = m;
+	g_maps_size += map_size(m);
+	return 0;
+}
 
-static void edit_quad(void)
+static int find_pending(const char *path)
 {
-	struct v2b tv;
-	struct v2b qv;
-	int t;
-	uint8_t *q;
+	int i;
 
-	rel_sel(&g_tsel, &tv);
-	rel_sel(&g_qsel, &qv);
-	t = tv.x + tv.y * 8 + g_tsel_page * 24;
-	q = g_quad_data[g_place][qv.y] + qv.x;
-	*q = t;
-	g_tms.tm[g_qtsel.pos.y][g_qtsel.pos.x + 1] = t;
-	g_tms.tm[qv.y + 3][qv.x + 3] = t;
+	for (i = 0; i < g_pending_count; i++) {
+		if (strcmp(g_pending[i], path) == 0) {
+			return i;
+		}
+	}
+	return -1;
 }
 
-static void mod_tsel(void)
+static void prefetch_map(const char *path)
 {
-	int tx, ty;
-	int t;
-	int n;
+	if (!g_loading || !*path || find_map(path) || 
+			find_pending(path) >= 0) {
+		return;
+	}
+	if (loader_request(path) == 0) {
+		strcpy(g_pending[g_pending_count++], path);
+	}
+}
 
-	t = g_tsel_page * 24;
-	ty = 5;
+/*
+ * A prefetch only fills free budget, unless it is the map being opened.
+ * One that was read from disk meanwhile loses to that copy.
+ */
+static void finish_load(const struct load_res *res, const char *want)
+{
+	struct map *m;
+	int i;
 
-	n = 32;
-	while (n-- > 0) {
-		struct v2b av;
+	i = find_pending(res->path);
+	memmove(g_pending[i], g_pending[--g_pending_count], 
+			sizeof(*g_pending));
 
-		if (t % 8 == 0) {
-			tx = 3;
-			ty += 2;
+	m = res->data;
+	if (!m) {
+		return;
+	}
+	if (!find_map(m->path)) {
+		drop_stray_texts(m);
+		if (want && strcmp(m->path, want) == 0) {
+			if (add_map(m) == 0) {
+				g_prefetched++;
+				return;
+			}
+		} else if (g_map_count < MAX_MAPS && 
+				g_maps_size + map_size(m) <= MAP_BUDGET) {
+			g_maps[g_map_count++] = m;
+			g_maps_size += map_size(m);
+			g_prefetched++;
+			return;
 		}
+	}
+	free_map(m);
+}
 
-		get_abs_tpt(&av, tx, ty);
+static void take_prefetched(void)
+{
+	struct load_res res;
 
-		g_wms.tm[ty][tx] = MT_EMPTY;
-		g_tms.tm[av.y][av.x] = t++;
+	while (loader_take(&res) == 0) {
+		finish_load(&res, NULL);
+	}
+}
 
-		tx += 2;
+static void wait_prefetched(const char *path)
+{
+	struct load_res res;
+
+	while (find_pending(path) >= 0 && loader_wait(&res) == 0) {
+		finish_load(&res, path);
 	}
-	place_textf(15, 15, "%d/3", g_tsel_page + 1);
 }
 
-static void place_prop(void)
+/*maps left recently are the likeliest to be opened again*/
+static void note_recent(const char *path)
 {
-	int prop;
-	const char *str;
+	int i;
 
-	prop = g_qprops[g_place];
-	if (prop < _countof(g_prop_strs)) {
-		str = g_prop_strs[prop];	
-	} else {
-		str = "TBD  ";
+	for (i = 0; i < MAX_RECENT - 1; i++) {
+		if (strcmp(g_recent[i], path) == 0) {
+			break;
+		}
+	}
+	memmove(g_recent[1], g_recent[0], i * sizeof(*g_recent));
+	strcpy(g_recent[0], path);
+
+	for (i = 1; i < MAX_RECENT; i++) {
+		prefetch_map(g_recent[i]);
 	}
-	place_textf(6, 3, "%s\n%3d", str, prop);
 }
 
-static void mod_prop(int off)
+static void use_map(struct map *m)
 {
-	int old;
+	if (g_map) {
+		g_map->cam[0] = g_cam_px[0];
+		g_map->cam[1] = g_cam_px[1];
+	}
+	g_map = m;
+	m->used = ++g_map_clock;
+	note_recent(m->path);
+
+	g_cam_px[0] = m->cam[0];
+	g_cam_px[1] = m->cam[1];
+	g_cam[0] = g_cam_px[0] / 16;
+	g_cam[1] = g_cam_px[1] / 16;
+	g_cam_dir[0] = 0;
+	g_cam_dir[1] = 0;
+	g_tms.scroll.x = g_cam_px[0] & 255;
+	g_tms.scroll.y = g_cam_px[1] & 255;
+	g_marked = 0;
+
+	/*undo records name cells of the map they were made on*/
+	undo_clear();
+	tm_to_qm_screen();
+	if (g_render_path == RP_QUAD) {
+		upload_map();
+	}
+	sync_cam();
 
-	old = g_qprops[g_place];
-	g_qprops[g_place] += off;
+	bound_qm_sel();
+	g_qm_sel.pos.x = MIN(g_qm_sel.pos.x, g_qm_sel.br.x);
+	g_qm_sel.pos.y = MIN(g_qm_sel.pos.y, g_qm_sel.br.y);
+	damage();
+}
 
-	if (old == QP_MSG) {
-		struct text *t; 
-		int n;
-	
-		t = g_texts;
-		n = g_text_count;
-		while (n--) {
-			int q;
+static int open_map(const char *path)
+{
+	struct map *m;
+
+	take_prefetched();
+	m = find_map(path);
+	if (m) {
+		g_map_hits++;
+	} else if (find_pending(path) >= 0) {
+		/*already on its way, reading it again would be slower*/
+		wait_prefetched(path);
+		m = find_map(path);
+		g_map_waits++;
+	}
 
-			q = g_qm_data[t->pos.y][t->pos.x];		
-			if (q == g_place) {
-				destroy_text(t);
-			}
-			t++;
+	if (!m) {
+		g_map_misses++;
+		m = new_map(path);
+		if (read_map(m, path) < 0 || add_map(m) < 0) {
+			free_map(m);
+			return -1;
 		}
 	}
+	use_map(m);
+	return 0;
 }
 
-static void change_prop(int off)
+static void read_quads(void)
 {
-	mod_prop(off);
-	place_prop();
+	fread_all_obj("../Poke/Shared/Tiles/QuadData00", 
+			g_quad_data, sizeof(g_quad_data));
+	fread_all_obj("../Poke/Shared/Tiles/QuadProps00",
+			g_qprops, sizeof(g_qprops));
 }
 
-static void tsel_key_cb(GLFWwindow *wnd, int key, 
-		int scancode, int action, int mode)
+static void set_up_map(void)
 {
-	if (action == GLFW_PRESS && !move_sel_kb(key, &g_tsel)) { 
-		switch (key) {
-		case GLFW_KEY_X:
-			edit_quad();
-			break;
-		case GLFW_KEY_Z:
-			set_state(qtsel_key_cb, NULL); 
-			break;
-		case GLFW_KEY_RIGHT:
-			g_tsel_page = wrap(g_tsel_page + 1, 0, 2);
-			mod_tsel();
-			break;
-		case GLFW_KEY_LEFT:
-			g_tsel_page = wrap(g_tsel_page - 1, 0, 2);
-			mod_tsel();
-			break;
+	struct map *m;
+	int tr;
+
+	tr = TRACE_BEGIN("read_quads");
+	read_quads();
+	TRACE_END(tr);
+	
+	if (g_render_path == RP_QUAD) {
+		qm_upload_quads(**g_quad_data);
+	}
+
+	/*a missing start map still leaves an empty one to edit*/
+	tr = TRACE_BEGIN("read_map");
+	m = new_map("PalletTown");
+	read_map(m, m->path);
+	add_map(m);
+	TRACE_END(tr);
+	tr = TRACE_BEGIN("use_map");
+	use_map(m);
+	TRACE_END(tr);
+}
+
+static const struct {
+	GLFWkeyfun fn;
+	const char *name;
+} g_states[] = {
+	{edit_key_cb, "edit"},
+	{msel_key_cb, "msel"},
+	{path_key_cb, "path"},
+	{quad_key_cb, "quad"},
+	{qsel_key_cb, "qsel"},
+	{qtsel_key_cb, "qtsel"},
+	{tsel_key_cb, "tsel"}
+};
+
+static int state_index(void)
+{
+	int i;
+
+	for (i = 0; i < _countof(g_states); i++) {
+		if (g_states[i].fn == g_key_fn) {
+			return i;
 		}
 	}
+	return 0;
 }
 
-static void open_tsel(void)
+static void feed_event(const struct input_ev *ev)
 {
-	set_state(tsel_key_cb, NULL); 
+	switch (ev->type) {
+	case IT_KEY:
+		key_cb(g_wnd, ev->code, ev->scancode, ev->action, ev->mods);
+		break;
+	case IT_CHAR:
+		char_cb(g_wnd, ev->code);
+		break;
+	}
 }
 
-static void qtsel_key_cb(GLFWwindow *wnd, int key, 
-		int scancode, int action, int mode)
+static int replay(const char *path, int paced)
 {
-	if (action == GLFW_PRESS && !move_sel_kb(key, &g_qtsel)) { 
-		switch (key) {
-		case GLFW_KEY_X:
-			open_tsel();
-			break;
-		case GLFW_KEY_Z:
-			open_qsel();
-			break;
-		case GLFW_KEY_UP:
-			change_prop(-1);
-			break;
-		case GLFW_KEY_DOWN:
-			change_prop(1);
-			break;
+	struct input_log log;
+	struct lat_hist hists[_countof(g_states)];
+	double start;
+	double due;
+	uint64_t h;
+	size_t i;
+	int res;
+
+	if (rec_load(path, &log) < 0) {
+		return 1;
+	}
+
+	if (state_hash() != log.start_hash) {
+		fprintf(stderr, "replay: start state differs from the "
+				"recording, results will not match\n");
+	}
+
+	memset(hists, 0, sizeof(hists));
+	start = get_time();
+	due = start;
+	for (i = 0; i < log.count; i++) {
+		const struct input_ev *ev;
+		struct lat_hist *hist;
+		double t;
+
+		ev = &log.evs[i];
+		if (paced) {
+			due += ev->delay / 1e6;
+			t = due - get_time();
+			if (t > 0.0) {
+				sleep_time(t);
+			}
+		}
+
+		/*latency is charged to the state that handled the event*/
+		hist = &hists[state_index()];
+		t = get_time();
+		feed_event(ev);
+		lat_add(hist, get_time() - t);
+
+		if (is_damaged()) {
+			render();
 		}
 	}
+	glFinish();
+
+	printf("replay: %zu events in %.3f s\n", 
+			log.count, get_time() - start);
+	for (i = 0; i < _countof(g_states); i++) {
+		lat_print(&hists[i], g_states[i].name);
+	}
+
+	h = state_hash();
+	printf("replay: map state %016llx\n", (unsigned long long) h);
+
+	res = 0;
+	if (!log.end_hash) {
+		fprintf(stderr, "replay: recording has no end state\n");
+	} else if (h != log.end_hash) {
+		fprintf(stderr, "replay: end state differs from the "
+				"recording (%016llx)\n", 
+				(unsigned long long) log.end_hash);
+		res = 1;
+	}
+
+	free(log.evs);
+	return res;
 }
 
-static void open_qtsel(void)
+static int glide_cam(double dt)
 {
-	uint8_t (*q)[2];
- 
-	place_box(1, 1, 19, 18); 
+	int held[2];
+	int d[2];
+	int step;
+	int x, y;
+	int i;
+
+	held[0] = 0;
+	held[1] = 0;
+	if (g_key_fn == edit_key_cb) {
+		held[0] = glfwGetKey(g_wnd, GLFW_KEY_RIGHT) - 
+				glfwGetKey(g_wnd, GLFW_KEY_LEFT);
+		held[1] = glfwGetKey(g_wnd, GLFW_KEY_DOWN) - 
+				glfwGetKey(g_wnd, GLFW_KEY_UP);
+	}
 
-	wm_q_to_t(3, 3, g_place);
+	/*a released axis glides on to the next quad edge*/
+	for (i = 0; i < 2; i++) {
+		if (held[i]) {
+			g_cam_dir[i] = held[i];
+		} else if (g_cam_px[i] % 16 == 0) {
+			g_cam_dir[i] = 0;
+		}
+	}
 
-	q = g_quad_data[g_place];
-	place_t_on_wm(14, 3, q[0][0]); 
-	place_t_on_wm(16, 3, q[0][1]); 
-	place_t_on_wm(14, 5, q[1][0]); 
-	place_t_on_wm(16, 5, q[1][1]); 
+	if (!g_cam_dir[0] && !g_cam_dir[1]) {
+		g_cam_speed = 0.0;
+		g_cam_rem = 0.0;
+		return 0;
+	}
 
-	g_qtsel.pos.x = 13;
-	g_qtsel.pos.y = 3;
-	g_wms.tm[g_qtsel.pos.y][g_qtsel.pos.x] = MT_FULL_HORZ_ARROW;
+	dt = MIN(dt, CAM_MAX_DT);
+	g_cam_speed = MAX(g_cam_speed, CAM_MIN_SPEED);
+	if (held[0] || held[1]) {
+		g_cam_speed = MIN(g_cam_speed + CAM_ACCEL * dt, CAM_MAX_SPEED);
+	}
+	g_cam_rem += g_cam_speed * dt;
+	step = (int) g_cam_rem;
+	g_cam_rem -= step;
 
-	g_tsel.pos.x = 2;
-	g_tsel.pos.y = 7;
-	g_tsel_page = 0;
-	g_wms.tm[g_tsel.pos.y][g_tsel.pos.x] = MT_FULL_HORZ_ARROW;
+	for (i = 0; i < 2; i++) {
+		d[i] = step;
+		if (!held[i]) {
+			int sub;
 
-	place_prop();	
+			sub = g_cam_px[i] % 16;
+			d[i] = MIN(step, g_cam_dir[i] > 0 ? 16 - sub : sub);
+		}
+		d[i] *= g_cam_dir[i];
+	}
 
-	mod_tsel();
-	set_state(qtsel_key_cb, NULL); 
+	x = g_cam_px[0];
+	y = g_cam_px[1];
+	scroll_cam(d[0], d[1]);
+
+	/*pushing against the edge of the map is not motion*/
+	return step == 0 || x != g_cam_px[0] || y != g_cam_px[1];
 }
 
-static void mod_qsel(void)
+static int run_window(const char *rec_path)
 {
-	int x;
-	int y;
-	int t;
+	double last;
 
-	x = 3;
-	y = 3;
-	t = 0;
+	if (rec_path && rec_open(rec_path, state_hash()) < 0) {
+		return 1;
+	}
 
-	while (t < 20) {
-		wm_q_to_t(x, y, t + g_qsel_page * 20); 
-		if (x < 15) {
-			x += 3;
+	last = glfwGetTime();
+	while (!glfwWindowShouldClose(g_wnd)) {
+		double now;
+		int moving;
+		int drawn;
+
+		take_prefetched();
+		now = glfwGetTime();
+		moving = g_smooth && glide_cam(now - last);
+		last = now;
+
+		drawn = is_damaged();
+		if (drawn) {
+			double t;
+
+			/*stats lag a frame so the HUD never causes a redraw*/
+			if (hud_shown()) {
+				place_hud();
+			}
+			t = glfwGetTime();
+			render();
+			t = glfwGetTime() - t;
+			g_render_time += t;
+			glfwSwapBuffers(g_wnd);
+			g_frames_drawn++;
+			sample_frame(t);
 		} else {
-			x = 3;
-			y += 3;
+			g_frames_idle++;
+		}
+
+		/*a gliding camera is paced by the swap, not by events*/
+		if (!moving) {
+			glfwWaitEvents();
+		} else if (drawn) {
+			glfwPollEvents();
+		} else {
+			glfwWaitEventsTimeout(CAM_IDLE_WAIT);
 		}
-		t++;
 	}
-	place_textf(15, 15, "%d/6", g_qsel_page + 1);
+
+	if (rec_path) {
+		rec_close(state_hash());
+	}
+	print_frame_stats();
+	return 0;
 }
 
-static void tm_to_qm_screen(void)
+static int run_headless(int frames)
 {
-	ivec4 cam_rc;
-	ivec2 scroll;
+	double t;
+	int n;
 
-	scroll[0] = g_tms.scroll.x / 8;
-	scroll[1] = g_tms.scroll.y / 8;
-	cam_rc[0] = g_cam[0];
-	cam_rc[1] = g_cam[1];
-	cam_rc[2] = g_cam[0] + 10;
-	cam_rc[3] = g_cam[1] + 9;
-	qm_to_tm(scroll, cam_rc);
+	t = get_time();
+	n = frames;
+	while (n-- > 0) {
+		/*every frame is a full redraw with full uploads*/
+		damage();
+		mark_rows(&g_tms, 0, TILE_MAP_LEN);
+		mark_rows(&g_wms, 0, TILE_MAP_LEN);
+		render();
+	}
+	glFinish();
+	t = get_time() - t;
+
+	printf("headless: startup %.2f ms, %d frames in %.2f ms "
+			"(%.3f ms per frame)\n", g_startup_time * 1000.0, 
+			frames, t * 1000.0, t * 1000.0 / frames);
+	return 0;
 }
 
-static void close_qsel(void)
+static void view_tm(struct tm_view *v, const struct tm_shader *tms)
 {
-	tm_to_qm_screen();
-	open_msel();
+	v->tm = tms->tm;
+	v->scroll = tms->scroll;
+	v->atlas = tms->atlas;
 }
 
-static void qsel_key_cb(GLFWwindow *wnd, int key,
-		int scancode, int action, int mode)
+static int check_frame(void)
 {
+	struct tm_view map;
+	struct tm_view win;
+	uint8_t *gpu;
+	uint8_t *cpu;
+	long bad;
+	int x;
+	int y;
 
-	if (action == GLFW_PRESS && !move_sel_kb(key, &g_qsel)) {
-		switch (key) {
-		case GLFW_KEY_X: 
-			update_place();
-			open_qtsel();
-			break;
-		case GLFW_KEY_Z:
-			close_qsel();
-			break;
-		case GLFW_KEY_RIGHT:
-			g_qsel_page = wrap(g_qsel_page + 1, 0, 5);
-			mod_qsel();
-			break;
-		case GLFW_KEY_LEFT:
-			g_qsel_page = wrap(g_qsel_page - 1, 0, 5);
-			mod_qsel();
-			break;
+	/*the quad path reads g_map->data, give the reference the same view*/
+	if (g_qms.active) {
+		g_qms.active = 0;
+		tm_to_qm_screen();
+		g_qms.active = 1;
+	}
+
+	damage();
+	render();
+
+	gpu = xmalloc(WND_WIDTH * WND_HEIGHT * 3);
+	cpu = xmalloc(NATIVE_WIDTH * NATIVE_HEIGHT * 4);
+	headless_read(gpu);
+	view_tm(&map, &g_tms);
+	view_tm(&win, &g_wms);
+	soft_render(&map, &win, cpu);
+
+	bad = 0;
+	for (y = 0; y < WND_HEIGHT; y++) {
+		const uint8_t *g;
+		const uint8_t *c;
+
+		/*GL rows run bottom up*/
+		g = gpu + (WND_HEIGHT - 1 - y) * WND_WIDTH * 3;
+		c = cpu + y * NATIVE_HEIGHT / WND_HEIGHT * NATIVE_WIDTH * 4;
+		for (x = 0; x < WND_WIDTH; x++) {
+			if (memcmp(g, c + x * NATIVE_WIDTH / WND_WIDTH * 4, 3)) {
+				bad++;
+			}
+			g += 3;
 		}
 	}
-}
 
-static void open_qsel(void)
-{
-	place_box(1, 1, 19, 18);
-	g_wms.tm[g_qsel.pos.y][g_qsel.pos.x] = MT_FULL_HORZ_ARROW;
-	mod_qsel();
-	set_state(qsel_key_cb, NULL);
+	printf("check: %ld of %d pixels differ from the reference\n", 
+			bad, WND_WIDTH * WND_HEIGHT);
+	free(gpu);
+	free(cpu);
+	return bad > 0;
 }
 
-static void init_glfw(void) 
-{
-	glfwSetErrorCallback(error_cb);
-	glfwInit();
-	atexit(glfwTerminate);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+typedef void (*expand_fn)(const uint8_t *quads, const uint8_t *ids, 
+		int n, uint8_t *top, uint8_t *bot);
 
-	g_wnd = glfwCreateWindow(WND_WIDTH, WND_HEIGHT, 
-			"poke_editor", NULL, NULL);
-	glfwMakeContextCurrent(g_wnd);
-	glfwSwapInterval(1);
+static double time_expand(expand_fn fn, int w, int h, int runs)
+{
+	uint8_t top[512];
+	uint8_t bot[512];
+	double t;
+	int n;
 
-	glfwSetInputMode(g_wnd, GLFW_LOCK_KEY_MODS, GLFW_TRUE);
-	glfwSetFramebufferSizeCallback(g_wnd, resize_cb);
-	open_edit();
+	t = get_time();
+	n = runs;
+	while (n-- > 0) {
+		int y;
 
-	if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-		fprintf(stderr, "glad error\n");
-		exit(1);
+		for (y = 0; y < h; y++) {
+			fn(**g_quad_data, g_map->data[y], w, top, bot);
+		}
 	}
+	return (get_time() - t) / runs;
 }
 
-static void fread_all_obj(const char *path, void *buf, size_t size)
+/*the parsers pulled every byte through xfgetc before spans*/
+static int read_map_stdio(struct map *m, const char *full)
 {
+	struct span s;
 	FILE *f;
+	long len;
+	long i;
+	int res;
 
-	f = xfopen(path, "rb");
-	xfread_obj(f, buf, size); 
+	f = fopen(full, "rb");
+	if (!f) {
+		return -1;
+	}
+	len = get_file_size(f);
+	s.data = xmalloc(len);
+	s.len = len;
+	s.pos = 0;
+	for (i = 0; i < len; i++) {
+		s.data[i] = xfgetc(f);
+	}
 	fclose(f);
+
+	res = parse_map(&s, m);
+	span_free(&s);
+	return res;
 }
 
-static void cd_parent(char *path)
+static int read_map_span(struct map *m, const char *full)
 {
-	char *find;
+	struct span s;
+	int res;
 
-	find = strrchr(path, '\\');
-	if (find) {
-		*find = '\0';
+	if (span_read_file(&s, full) < 0) {
+		return -1;
 	}
+	res = parse_map(&s, m);
+	span_free(&s);
+	return res;
 }
 
-static void set_default_directory(void)
+static double time_load(int (*fn)(struct map *, const char *), 
+		const char *path)
 {
-	char path[MAX_PATH];
+	char full[MAX_PATH];
+	double t;
+	int n;
 
-	GetModuleFileName(NULL, path, MAX_PATH);
-	cd_parent(path);
-	cd_parent(path);
-	SetCurrentDirectory(path);
+	map_path(full, path);
+	t = get_time();
+	n = BENCH_LOAD_RUNS;
+	while (n-- > 0) {
+		struct map *m;
+
+		m = new_map(path);
+		fn(m, full);
+		free_map(m);
+	}
+	return (get_time() - t) / BENCH_LOAD_RUNS;
 }
 
-static void decomp_map_quads(FILE *f)
+static void bench_loads(void)
 {
-	int x, y;
+	DIR *dir;
+	struct dirent *ent;
+	double span;
+	double stdio;
 	int n;
 
-	x = 0;
-	y = 0;
-	n = g_qm_width * g_qm_height;
-	while (n > 0) {
-		int raw;
-		int quad;
-		int repeat;
+	dir = opendir("../Poke/Shared/Maps/");
+	if (!dir) {
+		fprintf(stderr, "bench: cannot open maps directory\n");
+		return;
+	}
 
-		raw = xfgetc(f);
-		quad = raw & 127;
-		repeat = 0;
+	span = 0.0;
+	stdio = 0.0;
+	n = 0;
+	while ((ent = readdir(dir))) {
+		const char *name;
 
-		if (raw == quad) {
-			repeat = 1;
-		} else {
-			repeat = xfgetc(f) + 1; 
+		name = ent->d_name;
+		if (*name == '.' || strlen(name) >= MAX_MAP_PATH) {
+			continue;
 		}
+		span += time_load(read_map_span, name);
+		stdio += time_load(read_map_stdio, name);
+		n++;
+	}
+	closedir(dir);
 
-		if (repeat > n) {
-			fprintf(f, "read_map: quad overflow");
-			exit(1);
-		}
+	printf("bench: loading %d maps: span %.3f us, xfgetc %.3f us\n", 
+			n, span * 1e6, stdio * 1e6);
+}
 
-		n -= repeat;
+typedef int (*decomp_fn)(struct span *s, uint8_t *dst, int stride, 
+		int w, int h);
 
-		while (repeat-- > 0) {
-			g_qm_data[y][x] = quad;
-			x++;
-			if (x >= g_qm_width) {
-				x = 0;
-				y++;
-			}
-		}
+static double time_decomp(decomp_fn fn, uint8_t *buf, size_t size, 
+		map_row *out)
+{
+	struct span s;
+	double t;
+	int n;
+
+	t = get_time();
+	n = BENCH_DECOMP_RUNS;
+	while (n-- > 0) {
+		s.data = buf;
+		s.len = size;
+		s.pos = 0;
+		fn(&s, *out, sizeof(*out), 256, 256);
 	}
+	return (get_time() - t) / BENCH_DECOMP_RUNS;
 }
 
-static void read_pstr(FILE *f, char *s, int n)
+static int bench_decomp(const char *name, map_row *src)
 {
-	int len;
-
-	len = xfgetc(f);
-	if (n <= len) {
-		fprintf(stderr, "Too long of pstr!\n");
-		exit(1);
+	static map_row out[2][256];
+	struct span s;
+	uint8_t *buf;
+	size_t size;
+	double t[2];
+	int res;
+
+	buf = xmalloc(MAX_MAP_FILE);
+	size = comp_quads(buf, *src, sizeof(*src), 256, 256);
+
+	s.data = buf;
+	s.len = size;
+	s.pos = 0;
+	decomp_quads(&s, *out[0], sizeof(*out[0]), 256, 256);
+	s.pos = 0;
+	decomp_quads_ref(&s, *out[1], sizeof(*out[1]), 256, 256);
+	res = memcmp(out[0], out[1], sizeof(out[0])) || 
+			memcmp(out[0], src, sizeof(out[0]));
+	if (res) {
+		fprintf(stderr, "bench: decomp_quads differs from "
+				"the reference on %s\n", name);
+	} else {
+		t[0] = time_decomp(decomp_quads, buf, size, out[0]);
+		t[1] = time_decomp(decomp_quads_ref, buf, size, out[1]);
+		printf("bench: %s, 256x256 quads in %lu bytes: "
+				"decoder %.1f Mquads/s, "
+				"reference %.1f Mquads/s\n", 
+				name, (unsigned long) size, 
+				65536 / t[0] * 1e-6, 65536 / t[1] * 1e-6);
 	}
-	xfread_obj(f, s, len);
-	s[len] = '\0';
+	free(buf);
+	return res;
 }
 
-static void read_texts(FILE *f)
+/*every cell its own literal, then one quad in runs of the longest (256)*/
+static int bench_decomps(void)
 {
-	struct text *t;
-	int n;
-
-	g_text_count = 0;
+	static map_row src[256];
+	int i;
 
-	t = g_texts; 
-	n = xfgetc(f);
-	
-	if (n > MAX_TEXTS) {
-		fprintf(stderr, "Too many texts!");
-		exit(1);
+	for (i = 0; i < 256 * 256; i++) {
+		src[i / 256][i % 256] = i % 127;
+	}
+	if (bench_decomp("single runs", src)) {
+		return 1;
 	}
 
-	while (n--) {
-		int x, y, q;
+	memset(src, 0, sizeof(src));
+	return bench_decomp("longest runs", src);
+}
 
-		x = xfgetc(f);
-		y = xfgetc(f);
+typedef void (*tile_fn)(const uint8_t *src, uint8_t *dst, int stride);
 
-		q = g_qm_data[y][x];
-		if (g_qprops[q] != QP_MSG) {
-			continue;
-		}
+static double time_tiles(tile_fn fn, const uint8_t *src, uint8_t *dst)
+{
+	double t;
+	int n;
 
-		t->pos.x = x;
-		t->pos.y = y;
-		read_pstr(f, t->str, TEXT_SIZE);
-		g_text_count++;
-		t++;
+	t = get_time();
+	n = BENCH_TILE_RUNS;
+	while (n-- > 0) {
+		int i;
+
+		for (i = 0; i < BENCH_TILES; i++) {
+			fn(src + i * TILE_BYTES, dst + i * 64, 8);
+		}
 	}
+	return (get_time() - t) / BENCH_TILE_RUNS;
 }
 
-static void read_objects(FILE *f)
+static int bench_tiles(void)
 {
-	struct object *o;
-	int n;
+	uint8_t *src;
+	uint8_t *dst[2];
+	double t[2];
+	int res;
+	int i;
+
+	src = xmalloc(BENCH_TILES * TILE_BYTES);
+	dst[0] = xmalloc(BENCH_TILES * 64);
+	dst[1] = xmalloc(BENCH_TILES * 64);
+	srand(1);
+	for (i = 0; i < BENCH_TILES * TILE_BYTES; i++) {
+		src[i] = rand();
+	}
 
-	g_object_count = 0;
+	t[0] = time_tiles(decomp_tile_lut, src, dst[0]);
+	t[1] = time_tiles(decomp_tile, src, dst[1]);
+	res = memcmp(dst[0], dst[1], BENCH_TILES * 64) != 0;
+	if (res) {
+		fprintf(stderr, "bench: decomp_tile differs from "
+				"decomp_tile_lut\n");
+	} else {
+		printf("bench: tiles: lut %.1f Mtiles/s, sse2 %.1f Mtiles/s\n",
+				BENCH_TILES / t[0] * 1e-6, 
+				BENCH_TILES / t[1] * 1e-6);
+	}
+	free(src);
+	free(dst[0]);
+	free(dst[1]);
+	return res;
+}
 
-	o = g_objects;
-	n = g_object_count;
+static int run_bench(void)
+{
+	uint8_t top[2][512];
+	uint8_t bot[2][512];
+	double t;
+	int w, h;
+	int n;
+	int y;
 
-	if (n > MAX_OBJS) {
-		fprintf(stderr, "Too many objects!");
-		exit(1);
+	for (y = 0; y < g_map->height; y++) {
+		expand_quads(**g_quad_data, g_map->data[y], g_map->width, 
+				top[0], bot[0]);
+		expand_quads_ref(**g_quad_data, g_map->data[y], g_map->width, 
+				top[1], bot[1]);
+		if (memcmp(top[0], top[1], g_map->width * 2) || 
+				memcmp(bot[0], bot[1], g_map->width * 2)) {
+			fprintf(stderr, "bench: expand_quads differs from "
+					"the reference in row %d\n", y);
+			return 1;
+		}
 	}
 
-	while (n--) {
-		o->pos.x = xfgetc(f);
-		o->pos.y = xfgetc(f);
-		o->dir = xfgetc(f);
-		o->speed = xfgetc(f);
-		o->tile = xfgetc(f);
-		read_pstr(f, o->str, TEXT_SIZE);
-		o++;
+	/*a screen restream covers the view and its margin*/
+	w = MIN(VIEW_QUADS_X + 2, g_map->width);
+	h = MIN(VIEW_QUADS_Y + 2, g_map->height);
+	t = get_time();
+	n = BENCH_SCREEN_RUNS;
+	while (n-- > 0) {
+		tm_to_qm_screen();
+	}
+	t = (get_time() - t) / BENCH_SCREEN_RUNS;
+	printf("bench: screen %dx%d quads: restream %.3f us, "
+			"kernel %.3f us, reference %.3f us\n", 
+			VIEW_QUADS_X + 2, VIEW_QUADS_Y + 2, t * 1e6, 
+			time_expand(expand_quads, w, h, 
+				BENCH_SCREEN_RUNS) * 1e6, 
+			time_expand(expand_quads_ref, w, h, 
+				BENCH_SCREEN_RUNS) * 1e6);
+
+	w = g_map->width;
+	h = g_map->height;
+	printf("bench: map %dx%d quads: kernel %.3f us, "
+			"reference %.3f us\n", w, h, 
+			time_expand(expand_quads, w, h, 
+				BENCH_MAP_RUNS) * 1e6, 
+			time_expand(expand_quads_ref, w, h, 
+				BENCH_MAP_RUNS) * 1e6);
+
+	bench_loads();
+	if (bench_decomps()) {
+		return 1;
 	}
+	return bench_tiles();
 }
 
-static char *strccpy(char *dst, const char *src)
+static void print_usage(void)
 {
-	while ((*dst++ = *src++));
-	return dst - 1;
+	fprintf(stderr, "usage: editor [--verify | --bench] "
+			"[--pull | --composite | --quad] "
+			"[--disk-shaders] [--trace file]\n"
+			"              [--smooth | --record file | "
+			"--replay file [--paced]]\n"
+			"              [--headless [--frames n] [--dump file.ppm] "
+			"[--check]]\n");
 }
 
-static void read_map(const char *path)
+int main(int argc, char **argv) 
 {
-	FILE *f;
-	char full[MAX_PATH];
-	char *s;
-
-	s = strccpy(full, "../Poke/Shared/Maps/");
-	strcpy(s, path);
+	const char *trace_path;
+	const char *rec_path;
+	const char *replay_path;
+	const char *dump_path;
+	GLADloadproc load;
+	int frames;
+	int check;
+	int paced;
+	int verify;
+	int bench;
+	int res;
+	int i;
+	int tr;
+	int startup;
+	double t;
+
+	t = get_time();
+
+	trace_path = NULL;
+	rec_path = NULL;
+	replay_path = NULL;
+	dump_path = NULL;
+	frames = 1;
+	check = 0;
+	paced = 0;
+	verify = 0;
+	bench = 0;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+			trace_init(TRACE_CAP);
+		} else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			rec_path = argv[++i];
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay_path = argv[++i];
+			g_replaying = 1;
+		} else if (strcmp(argv[i], "--paced") == 0) {
+			paced = 1;
+		} else if (strcmp(argv[i], "--smooth") == 0) {
+			g_smooth = 1;
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			g_headless = 1;
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+			if (frames < 1) {
+				frames = 1;
+			}
+		} else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+			dump_path = argv[++i];
+		} else if (strcmp(argv[i], "--check") == 0) {
+			check = 1;
+		} else if (strcmp(argv[i], "--verify") == 0) {
+			verify = 1;
+		} else if (strcmp(argv[i], "--bench") == 0) {
+			bench = 1;
+		} else if (strcmp(argv[i], "--pull") == 0) {
+			g_render_path = RP_PULL;
+		} else if (strcmp(argv[i], "--composite") == 0) {
+			g_render_path = RP_COMP;
+		} else if (strcmp(argv[i], "--quad") == 0) {
+			g_render_path = RP_QUAD;
+		} else if (strcmp(argv[i], "--disk-shaders") == 0) {
+			g_disk_shaders = 1;
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
 
-	f = fopen(full, "rb");
-	if (!f) {
-		fprintf(stderr, "map: cannot find map\n");
-		return;
+	if (rec_path && (replay_path || g_headless)) {
+		fprintf(stderr, "editor: recording needs a live window\n");
+		return 1;
+	}
+	if (g_smooth && (rec_path || replay_path || g_headless)) {
+		fprintf(stderr, "editor: --smooth is timing dependent "
+				"and needs a live, unrecorded window\n");
+		return 1;
+	}
+	if ((dump_path || check) && !g_headless) {
+		fprintf(stderr, "editor: --dump and --check need --headless\n");
+		return 1;
 	}
 
-	strcpy(g_path, path);
+	/*paths on the command line are relative to where we were started*/
+	fix_path(&trace_path);
+	fix_path(&rec_path);
+	fix_path(&replay_path);
+	fix_path(&dump_path);
 
-	g_qm_width = xfgetc(f) + 1;
-	g_qm_height = xfgetc(f) + 1;
-	
-	decomp_map_quads(f);
-	g_def_quad = xfgetc(f);
-	read_texts(f);
-	read_objects(f);
+	/*--verify and --bench return early, but record spans too*/
+	g_trace_path = trace_path;
+	atexit(write_trace);
 
-	fclose(f);
-}
+	startup = TRACE_BEGIN("startup");
+	tr = TRACE_BEGIN("set_default_directory");
+	set_default_directory();
+	TRACE_END(tr);
 
-static void set_up_map(void)
-{
-	static ivec2 origin = {0, 0};
-	static ivec4 region = {0, 0, 10, 9};
+	if (verify) {
+		read_quads();
+		return verify_all_maps();
+	}
 
-	fread_all_obj("../Poke/Shared/Tiles/QuadData00", 
-			g_quad_data, sizeof(g_quad_data));
-	fread_all_obj("../Poke/Shared/Tiles/QuadProps00",
-			g_qprops, sizeof(g_qprops));
-	
-	g_qm_width = 1;
-	g_qm_height = 1;
-	read_map("PalletTown");
-	qm_to_tm(origin, region);
-}
+	if (bench) {
+		/*the benchmark runs without a GL context*/
+		g_render_path = RP_GEOM;
+		set_up_map();
+		return run_bench();
+	}
 
-int main(void) 
-{
-	set_default_directory();
-	init_glfw();
-	init_gl();
+	if (g_headless) {
+		tr = TRACE_BEGIN("headless_init");
+		load = headless_init(WND_WIDTH, WND_HEIGHT);
+		TRACE_END(tr);
+		if (!load) {
+			return 1;
+		}
+	} else {
+		tr = TRACE_BEGIN("init_glfw");
+		init_glfw();
+		TRACE_END(tr);
+		load = (GLADloadproc) glfwGetProcAddress;
+	}
+	open_edit();
+	tr = TRACE_BEGIN("init_gl");
+	init_gl(load);
+	TRACE_END(tr);
+	undo_init(UNDO_BUDGET);
+	tr = TRACE_BEGIN("set_up_map");
 	set_up_map();
+	TRACE_END(tr);
+	if (loader_start(decode_map) == 0) {
+		g_loading = 1;
+		atexit(loader_stop);
+	}
+	TRACE_END(startup);
+	g_startup_time = get_time() - t;
 
-	while (!glfwWindowShouldClose(g_wnd)) {
-		render();
-		glfwSwapBuffers(g_wnd);
-		glfwWaitEvents();
+	if (replay_path) {
+		res = replay(replay_path, paced);
+	} else if (g_headless) {
+		res = run_headless(frames);
+	} else {
+		res = run_window(rec_path);
 	}
 
-	return 0;
+	if (check && check_frame()) {
+		res = 1;
+	}
+	if (dump_path && headless_dump(dump_path) < 0) {
+		res = 1;
+	}
+	return res;
 }
-
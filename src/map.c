@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "map.h"
+
+int decomp_quads(struct span *s, uint8_t *dst, int stride, int w, int h)
+{
+	uint8_t *row;
+	int x;
+	int n;
+
+	row = dst;
+	x = 0;
+	n = w * h;
+	while (n > 0) {
+		int raw;
+		int quad;
+		int repeat;
+
+		raw = span_getc(s);
+		if (raw < 0) {
+			return -1;
+		}
+
+		quad = raw & 127;
+
+		if (raw == quad) {
+			/*literals are the common case, skip the memset*/
+			row[x++] = quad;
+			if (x >= w) {
+				x = 0;
+				row += stride;
+			}
+			n--;
+			continue;
+		}
+
+		repeat = span_getc(s);
+		if (repeat < 0) {
+			return -1;
+		}
+		repeat++;
+
+		if (repeat > n) {
+			fprintf(stderr, "map: quad overflow\n");
+			return -1;
+		}
+
+		n -= repeat;
+
+		while (repeat > 0) {
+			int len;
+
+			len = MIN(repeat, w - x);
+			memset(row + x, quad, len);
+			repeat -= len;
+			x += len;
+			if (x >= w) {
+				x = 0;
+				row += stride;
+			}
+		}
+	}
+	return 0;
+}
+
+/*the per cell loop decomp_quads replaced, kept to check and time it*/
+int decomp_quads_ref(struct span *s, uint8_t *dst, int stride, int w, int h)
+{
+	int x, y;
+	int n;
+
+	x = 0;
+	y = 0;
+	n = w * h;
+	while (n > 0) {
+		int raw;
+		int quad;
+		int repeat;
+
+		raw = span_getc(s);
+		if (raw < 0) {
+			return -1;
+		}
+
+		quad = raw & 127;
+		repeat = 1;
+		if (raw != quad) {
+			repeat = span_getc(s);
+			if (repeat < 0) {
+				return -1;
+			}
+			repeat++;
+		}
+
+		if (repeat > n) {
+			fprintf(stderr, "map: quad overflow\n");
+			return -1;
+		}
+
+		n -= repeat;
+		while (repeat-- > 0) {
+			dst[y * stride + x] = quad;
+			x++;
+			if (x >= w) {
+				x = 0;
+				y++;
+			}
+		}
+	}
+	return 0;
+}
+
+static uint8_t *comp_run(uint8_t *out, int quad, int n)
+{
+	/*a repeat costs two bytes, so runs of one or two stay literal*/
+	while (n > 2) {
+		int len;
+
+		len = MIN(n, 256);
+		*out++ = quad | 128;
+		*out++ = len - 1;
+		n -= len;
+	}
+	while (n-- > 0) {
+		*out++ = quad;
+	}
+	return out;
+}
+
+size_t comp_quads(uint8_t *dst, const uint8_t *src, int stride, int w, int h)
+{
+	uint8_t *out;
+	int quad;
+	int run;
+	int y;
+
+	out = dst;
+	quad = -1;
+	run = 0;
+	for (y = 0; y < h; y++) {
+		const uint8_t *row;
+		int x;
+
+		row = src + y * stride;
+		for (x = 0; x < w; x++) {
+			if (row[x] == quad) {
+				run++;
+			} else {
+				out = comp_run(out, quad, run);
+				quad = row[x];
+				run = 1;
+			}
+		}
+	}
+	out = comp_run(out, quad, run);
+	return out - dst;
+}
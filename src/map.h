@@ -0,0 +1,13 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdint.h>
+
+#include "xstd.h"
+
+int decomp_quads(struct span *s, uint8_t *dst, int stride, int w, int h);
+int decomp_quads_ref(struct span *s, uint8_t *dst, int stride, 
+		int w, int h);
+size_t comp_quads(uint8_t *dst, const uint8_t *src, int stride, int w, int h);
+
+#endif
@@ -2,12 +2,71 @@
 #include <stdarg.h>
 #include <string.h>
 
+#include "cache.h"
 #include "render.h"
+#include "shaders.h"
+#include "tile.h"
 #include "xstd.h"
 
 GLuint g_pal;
+const uint8_t g_pal_rgb[4][3] = {
+	{0xFF, 0xEF, 0xFF},
+	{0xA8, 0xA8, 0xA8},
+	{0x80, 0x80, 0x80},
+	{0x10, 0x10, 0x18}
+};
+
 struct tm_shader g_tms;
 struct tm_shader g_wms;
+struct qm_shader g_qms;
+
+size_t g_upload_bytes;
+int g_render_path = RP_GEOM;
+int g_disk_shaders;
+int g_gpu_timing;
+double g_gpu_time[TL_COUNT];
+
+struct comp_shader {
+	GLuint prog;
+	GLuint vao;
+
+	GLint tm_scroll_loc;
+	GLint wm_scroll_loc;
+
+	GLuint ids;
+	GLuint tex;
+};
+
+static struct comp_shader g_cs;
+
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint prog, 
+		GLsizei size, GLsizei *len, GLenum *fmt, void *buf);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint prog, 
+		GLenum fmt, const void *buf, GLsizei len);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint prog, 
+		GLenum name, GLint val);
+
+static PFNGLGETPROGRAMBINARYPROC get_program_binary;
+static PFNGLPROGRAMBINARYPROC program_binary;
+static PFNGLPROGRAMPARAMETERIPROC program_parameteri;
+static uint64_t g_driver_key = HASH_SEED;
+
+static int g_damaged = 1;
+
+/*everything is drawn at native size, then blown up in one blit*/
+static GLuint g_native_fbo;
+static GLuint g_native_rb;
+static GLuint g_target_fbo;
+static int g_present[4];
+
+/*two sets of timer queries, a set is read back before it is reused*/
+static GLuint g_queries[2][TL_COUNT];
+static int g_query_live[2][TL_COUNT];
+static int g_query_set;
 
 static void prog_print(const char *msg, int prog) 
 {
@@ -22,7 +81,7 @@ static void prog_printf(const char *fmt, int prog, ...)
 	char msg[1024];
 
 	va_start(ap, prog);
-	vsprintf_s(msg, sizeof(msg), fmt, ap);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
 	va_end(ap);
 	prog_print(msg, prog);
 }
@@ -33,9 +92,15 @@ static GLuint link_shaders(GLuint vs, GLuint gs, GLuint fs)
 	GLint success;
 
 	prog = glCreateProgram();
+	if (program_parameteri) {
+		program_parameteri(prog, 
+				GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 
 	glAttachShader(prog, vs);
-	glAttachShader(prog, gs);
+	if (gs) {
+		glAttachShader(prog, gs);
+	}
 	glAttachShader(prog, fs);
 
 	glLinkProgram(prog);
@@ -45,10 +110,14 @@ static GLuint link_shaders(GLuint vs, GLuint gs, GLuint fs)
 	}
 
 	glDetachShader(prog, fs);
-	glDetachShader(prog, gs);
+	if (gs) {
+		glDetachShader(prog, gs);
+	}
 	glDetachShader(prog, vs);
 	glDeleteShader(fs);
-	glDeleteShader(gs);
+	if (gs) {
+		glDeleteShader(gs);
+	}
 	glDeleteShader(vs);
 
 	return prog;
@@ -75,55 +144,17 @@ static void pad_tile(uint8_t *tile)
 	}
 }
 
-static int get_px(int px, int shift)
-{
-	return ((px >> shift) & 3) << 6;
-}
+/*cached atlases of older versions are never served, bump on any change*/
+#define ATLAS_VERSION 1
 
-static int decomp_tile(FILE *f, uint8_t *tile) 
+static void decomp_tile_data(struct span *s, void *buf, 
+		size_t size, int pad)
 {
-	uint8_t *t;
-	int i;
-
-	t = tile;
-	i = 8;
-	while (i-- > 0) {
-		uint8_t *b;
-		int j;
-
-		b = t;
-		j = 2;
-		while (j-- > 0) {
-			int c;
-
-			c = fgetc(f);
-			if (c == EOF) {
-				return -1;
-			}
-
-			b[0] = get_px(c, 6);
-			b[1] = get_px(c, 4);
-			b[2] = get_px(c, 2);
-			b[3] = get_px(c, 0);
-			b += 4;
-		}
-		t += 128;
-	}
-	return 0;
-}
-
-static uint8_t *read_tile_data(const char *path, int pad)
-{
-	uint8_t *tile_data;
-	FILE *f;
 	uint8_t *r;
 	int i;
 
-	tile_data = xmalloc(128 * 128);
-
-	f = xfopen(path, "rb");
-
-	r = tile_data;
+	memset(buf, 0, size);
+	r = buf;
 
 	i = 16;
 	while (i-- > 0) {
@@ -136,15 +167,28 @@ static uint8_t *read_tile_data(const char *path, int pad)
 			if (pad > 0) {
 				pad_tile(t);
 				pad--;
-			} else if (decomp_tile(f, t) < 0) {
-				goto end;
+			} else if (span_left(s) < TILE_BYTES) {
+				return;
+			} else {
+				decomp_tile(s->data + s->pos, t, 128);
+				s->pos += TILE_BYTES;
 			}
 			t += 8;
 		}
 		r += 128 * 8;
 	}
-end:
-	fclose(f);
+}
+
+static uint8_t *read_tile_data(const char *path, int pad)
+{
+	uint8_t *tile_data;
+	int tr;
+
+	tr = TRACE_BEGIN("decode tiles");
+	tile_data = xmalloc(128 * 128);
+	cache_fetch(path, pad, ATLAS_VERSION, tile_data, 128 * 128, 
+			decomp_tile_data);
+	TRACE_END(tr);
 	return tile_data;
 }
 
@@ -163,13 +207,26 @@ static char *fread_all_str(const char *path)
 	return buf;
 }
 
-static GLuint load_tile_data(const char *path, int pad)
+static char *read_shader(const char *path)
 {
-	GLuint tex;
-	uint8_t *tile_data;
+	const struct shader_src *s;
 
-	glGenTextures(1, &tex);
-	glBindTexture(GL_TEXTURE_2D, tex);
+	if (!g_disk_shaders) {
+		for (s = g_shader_srcs; s->path; s++) {
+			if (strcmp(s->path, path) == 0) {
+				return xstrdup(s->src);
+			}
+		}
+	}
+	return fread_all_str(path);
+}
+
+static void load_tile_data(struct tm_shader *tms, const char *path, int pad)
+{
+	int tr;
+
+	glGenTextures(1, &tms->tex);
+	glBindTexture(GL_TEXTURE_2D, tms->tex);
 
   	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -178,23 +235,16 @@ static GLuint load_tile_data(const char *path, int pad)
 			GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	tile_data = read_tile_data(path, pad);
+	tms->atlas = read_tile_data(path, pad);
+	tr = TRACE_BEGIN("upload tiles");
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, 
 			128, 128, 0, GL_RED, 
-			GL_UNSIGNED_BYTE, tile_data);
-	free(tile_data);
-
-	return tex;
+			GL_UNSIGNED_BYTE, tms->atlas);
+	TRACE_END(tr);
 }
 
 static void load_pallete(void)
 {
-	static const uint8_t pallete[] = {
-        	0xFF, 0xEF, 0xFF,
-        	0xA8, 0xA8, 0xA8,
-        	0x80, 0x80, 0x80,
-        	0x10, 0x10, 0x18
-	};
 
 	glGenTextures(1, &g_pal);
 	glBindTexture(GL_TEXTURE_1D, g_pal);
@@ -206,25 +256,34 @@ static void load_pallete(void)
 	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
 	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB, 4, 0, 
-			GL_RGB, GL_UNSIGNED_BYTE, pallete);
+			GL_RGB, GL_UNSIGNED_BYTE, g_pal_rgb);
 	/*
 	glBindTexture(GL_TEXTURE_1D, g_pal);
 	glTexSubImage1D(GL_TEXTURE_1D, 0, 0, 4, GL_RGB, 
-			GL_UNSIGNED_BYTE, pallete);
+			GL_UNSIGNED_BYTE, g_pal_rgb);
 	*/
 }
 
-static GLuint compile_shader(GLenum type, const char *path) 
+static GLuint compile_shader(GLenum type, const char *src, 
+		const char *defs, const char *path) 
 {
+	const char *strs[3];
+	GLint lens[3];
+	const char *nl;
 	GLuint shader;
-	char *src;
 	GLint success;
 
 	shader = glCreateShader(type);
 
-	src = fread_all_str(path);
-	glShaderSource(shader, 1, (const char **) &src, NULL); 
-	free(src);
+	/*feature defines have to come after the #version line*/
+	nl = strchr(src, '\n');
+	strs[0] = src;
+	lens[0] = nl ? nl - src + 1 : strlen(src);
+	strs[1] = defs;
+	lens[1] = -1;
+	strs[2] = src + lens[0];
+	lens[2] = -1;
+	glShaderSource(shader, 3, strs, lens); 
 
 	glCompileShader(shader);
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
@@ -235,20 +294,182 @@ static GLuint compile_shader(GLenum type, const char *path)
 	return shader;
 }
 
-static void load_tms(struct tm_shader *tms, const char *gs_path)
+static int has_ext(const char *name)
+{
+	GLint n;
+	GLint i;
+
+	glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+	for (i = 0; i < n; i++) {
+		if (strcmp((const char *) glGetStringi(GL_EXTENSIONS, i), 
+					name) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void init_prog_cache(GLADloadproc load)
+{
+	static const GLenum strs[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+
+	GLint major;
+	GLint minor;
+	GLint formats;
+	int i;
+
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major * 10 + minor < 41 && 
+			!has_ext("GL_ARB_get_program_binary")) {
+		return;
+	}
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats <= 0) {
+		return;
+	}
+
+	get_program_binary = load("glGetProgramBinary");
+	program_binary = load("glProgramBinary");
+	program_parameteri = load("glProgramParameteri");
+	if (!get_program_binary || !program_binary || !program_parameteri) {
+		get_program_binary = NULL;
+		program_binary = NULL;
+		program_parameteri = NULL;
+		return;
+	}
+
+	/*binaries are only valid for the driver that made them*/
+	g_driver_key = HASH_SEED;
+	for (i = 0; i < _countof(strs); i++) {
+		const char *str;
+
+		str = (const char *) glGetString(strs[i]);
+		g_driver_key = hash_bytes(str, strlen(str) + 1, g_driver_key);
+	}
+}
+
+static GLuint load_cached_prog(uint64_t key)
+{
+	struct span s;
+	uint32_t fmt;
+	GLuint prog;
+	GLint success;
+
+	if (!program_binary || cache_get(key, &s) < 0) {
+		return 0;
+	}
+
+	prog = 0;
+	if (span_read(&s, &fmt, sizeof(fmt)) == 0) {
+		prog = glCreateProgram();
+		program_binary(prog, fmt, s.data + s.pos, span_left(&s));
+		glGetProgramiv(prog, GL_LINK_STATUS, &success);
+		if (!success) {
+			/*driver update or a rejected binary, just recompile*/
+			glDeleteProgram(prog);
+			prog = 0;
+		}
+	}
+
+	span_free(&s);
+	return prog;
+}
+
+static void store_prog(GLuint prog, uint64_t key)
+{
+	GLint success;
+	GLint len;
+	GLenum fmt;
+	uint32_t f;
+	uint8_t *buf;
+
+	if (!get_program_binary) {
+		return;
+	}
+
+	glGetProgramiv(prog, GL_LINK_STATUS, &success);
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+	if (!success || len <= 0) {
+		return;
+	}
+
+	buf = xmalloc(sizeof(f) + len);
+	get_program_binary(prog, len, NULL, &fmt, buf + sizeof(f));
+	f = fmt;
+	memcpy(buf, &f, sizeof(f));
+	cache_put(key, buf, sizeof(f) + len);
+	free(buf);
+}
+
+static GLuint load_prog(const char *vs_path, const char *gs_path, 
+		const char *fs_path, const char *defs)
+{
+	static const GLenum types[] = {
+		GL_VERTEX_SHADER, 
+		GL_GEOMETRY_SHADER, 
+		GL_FRAGMENT_SHADER
+	};
+
+	const char *paths[3];
+	char *srcs[3];
+	GLuint shaders[3];
+	uint64_t key;
+	GLuint prog;
+	int i;
+	int tr;
+
+	tr = TRACE_BEGIN("load_prog");
+	paths[0] = vs_path;
+	paths[1] = gs_path;
+	paths[2] = fs_path;
+
+	key = hash_bytes(defs, strlen(defs) + 1, g_driver_key);
+	for (i = 0; i < 3; i++) {
+		srcs[i] = paths[i] ? read_shader(paths[i]) : xstrdup("");
+		key = hash_bytes(srcs[i], strlen(srcs[i]) + 1, key);
+	}
+
+	prog = load_cached_prog(key);
+	if (prog) {
+		g_cache_stats.prog_hits++;
+	} else {
+		int ctr;
+
+		ctr = TRACE_BEGIN("compile shaders");
+		for (i = 0; i < 3; i++) {
+			shaders[i] = paths[i] ? compile_shader(types[i], 
+					srcs[i], defs, paths[i]) : 0;
+		}
+		prog = link_shaders(shaders[0], shaders[1], shaders[2]);
+		TRACE_END(ctr);
+		store_prog(prog, key);
+		g_cache_stats.prog_misses++;
+	}
+
+	for (i = 0; i < 3; i++) {
+		free(srcs[i]);
+	}
+	TRACE_END(tr);
+	return prog;
+}
+
+static void load_tms(struct tm_shader *tms, const char *defs)
 {
 	static vec3 flip = {-1.0F, 1.0F, 0.0F};
 	static vec3 scale = {0.1F, -1.0/9.0F, 1.0F};
 
-	GLuint vs;
-	GLuint gs;
-	GLuint fs;
 	mat4 projection;
 	
-	vs = compile_shader(GL_VERTEX_SHADER, "res/shaders/tm.vert");
-	gs = compile_shader(GL_GEOMETRY_SHADER, gs_path);
-	fs = compile_shader(GL_FRAGMENT_SHADER, "res/shaders/tm.frag");
-	tms->prog = link_shaders(vs, gs, fs);
+	if (g_render_path == RP_PULL) {
+		tms->prog = load_prog("res/shaders/tm_pull.vert", NULL,
+				"res/shaders/tm.frag", defs);
+	} else {
+		tms->prog = load_prog("res/shaders/tm.vert", 
+				"res/shaders/tm.geom", 
+				"res/shaders/tm.frag", defs);
+	}
 
 	glGenVertexArrays(1, &tms->vao);
 	glGenBuffers(1, &tms->vbo);
@@ -262,30 +483,317 @@ static void load_tms(struct tm_shader *tms, const char *gs_path)
 	glVertexAttribIPointer(0, 1, GL_UNSIGNED_BYTE, 1, NULL);
 	glEnableVertexAttribArray(0);
 
+	glGenTextures(1, &tms->tbo);
+	glBindTexture(GL_TEXTURE_BUFFER, tms->tbo);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, tms->vbo);
+
 	glUseProgram(tms->prog);
 
 	tms->proj_loc = glGetUniformLocation(tms->prog, "projection");
 	tms->scroll_loc = glGetUniformLocation(tms->prog, "scroll");
 	tms->tex_loc = glGetUniformLocation(tms->prog, "tex");
 	tms->pal_loc = glGetUniformLocation(tms->prog, "pal");
+	tms->tiles_loc = glGetUniformLocation(tms->prog, "tiles");
 
 	glUniform1i(tms->tex_loc, 0);
 	glUniform1i(tms->pal_loc, 1);
+	glUniform1i(tms->tiles_loc, 2);
 
 	glm_mat4_identity(projection);
 	glm_translate(projection, flip); 
 	glm_scale(projection, scale);
 	glUniformMatrix4fv(tms->proj_loc, 1, GL_FALSE, (float *) projection); 
+
+	tms->dirty = ~0U;
+}
+
+static void set_nearest(GLenum target)
+{
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+static void load_layer(struct tm_shader *tms, const char *path, 
+		int pad, int layer)
+{
+	int tr;
+
+	tms->atlas = read_tile_data(path, pad);
+	tr = TRACE_BEGIN("upload tiles");
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, 
+			128, 128, 1, GL_RED, GL_UNSIGNED_BYTE, tms->atlas);
+	TRACE_END(tr);
+}
+
+static void load_comp(void)
+{
+	g_cs.prog = load_prog("res/shaders/comp.vert", NULL, 
+			"res/shaders/comp.frag", "");
+
+	glGenVertexArrays(1, &g_cs.vao);
+
+	glGenTextures(1, &g_cs.ids);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, g_cs.ids);
+	set_nearest(GL_TEXTURE_2D_ARRAY);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8UI, 
+			TILE_MAP_LEN, TILE_MAP_LEN, 2, 0, 
+			GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+
+	glGenTextures(1, &g_cs.tex);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, g_cs.tex);
+	set_nearest(GL_TEXTURE_2D_ARRAY);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, 128, 128, 2, 0, 
+			GL_RED, GL_UNSIGNED_BYTE, NULL);
+	load_layer(&g_tms, "../Poke/Shared/Tiles/TileData00", 0, 0);
+	load_layer(&g_wms, "../Poke/Shared/Tiles/TileDataMenu", 2, 1);
+
+	glUseProgram(g_cs.prog);
+	glUniform1i(glGetUniformLocation(g_cs.prog, "tex"), 0);
+	glUniform1i(glGetUniformLocation(g_cs.prog, "pal"), 1);
+	glUniform1i(glGetUniformLocation(g_cs.prog, "ids"), 2);
+	g_cs.tm_scroll_loc = glGetUniformLocation(g_cs.prog, "tm_scroll");
+	g_cs.wm_scroll_loc = glGetUniformLocation(g_cs.prog, "wm_scroll");
+
+	g_tms.dirty = ~0U;
+	g_wms.dirty = ~0U;
+}
+
+static GLuint make_uint_tex(int w, int h)
+{
+	GLuint tex;
+
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	set_nearest(GL_TEXTURE_2D);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, w, h, 0, 
+			GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+	return tex;
 }
 
-void init_gl(void)
+static void load_qms(void)
 {
+	g_qms.prog = load_prog("res/shaders/comp.vert", NULL, 
+			"res/shaders/qm.frag", "");
+
+	glGenVertexArrays(1, &g_qms.vao);
+
+	g_qms.qm = make_uint_tex(256, 256);
+	g_qms.quads = make_uint_tex(128, 4);
+
+	glUseProgram(g_qms.prog);
+	glUniform1i(glGetUniformLocation(g_qms.prog, "tex"), 0);
+	glUniform1i(glGetUniformLocation(g_qms.prog, "pal"), 1);
+	glUniform1i(glGetUniformLocation(g_qms.prog, "qm"), 2);
+	glUniform1i(glGetUniformLocation(g_qms.prog, "quads"), 3);
+	g_qms.cam_loc = glGetUniformLocation(g_qms.prog, "cam");
+	g_qms.size_loc = glGetUniformLocation(g_qms.prog, "size");
+	g_qms.def_loc = glGetUniformLocation(g_qms.prog, "def_quad");
+
+	g_qms.active = 1;
+}
+
+void qm_upload_rows(const uint8_t *data, int y, int n)
+{
+	glBindTexture(GL_TEXTURE_2D, g_qms.qm);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, 256, n, 
+			GL_RED_INTEGER, GL_UNSIGNED_BYTE, data + y * 256);
+	g_upload_bytes += 256 * n;
+	damage();
+}
+
+void qm_set_cell(int x, int y, int d)
+{
+	uint8_t b;
+
+	b = d;
+	glBindTexture(GL_TEXTURE_2D, g_qms.qm);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, 1, 1, 
+			GL_RED_INTEGER, GL_UNSIGNED_BYTE, &b);
+	g_upload_bytes++;
+	damage();
+}
+
+void qm_upload_quads(const uint8_t *quad_data)
+{
+	uint8_t quads[4][128];
+	int d;
+
+	/*one row per corner so a quad's tiles share a column*/
+	for (d = 0; d < 128; d++) {
+		int i;
+
+		for (i = 0; i < 4; i++) {
+			quads[i][d] = quad_data[d * 4 + i];
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, g_qms.quads);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 128, 4, 
+			GL_RED_INTEGER, GL_UNSIGNED_BYTE, quads);
+	g_upload_bytes += sizeof(quads);
+	damage();
+}
+
+void qm_set_quad_tile(int d, int i, int t)
+{
+	uint8_t b;
+
+	b = t;
+	glBindTexture(GL_TEXTURE_2D, g_qms.quads);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, d, i, 1, 1, 
+			GL_RED_INTEGER, GL_UNSIGNED_BYTE, &b);
+	g_upload_bytes++;
+	damage();
+}
+
+static void load_native(void)
+{
+	glGenRenderbuffers(1, &g_native_rb);
+	glBindRenderbuffer(GL_RENDERBUFFER, g_native_rb);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 
+			NATIVE_WIDTH, NATIVE_HEIGHT);
+
+	glGenFramebuffers(1, &g_native_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, g_native_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 
+			GL_RENDERBUFFER, g_native_rb);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != 
+			GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "gl error: native framebuffer is incomplete\n");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, g_target_fbo);
+}
+
+void set_target_fbo(GLuint fbo)
+{
+	g_target_fbo = fbo;
+	damage();
+}
+
+void set_present_rect(int x, int y, int w, int h)
+{
+	g_present[0] = x;
+	g_present[1] = y;
+	g_present[2] = w;
+	g_present[3] = h;
+	damage();
+}
+
+static void present(void)
+{
+	int scale;
+	int x, y;
+	int w, h;
+
+	/*the largest whole multiple that fits in the letterbox*/
+	scale = MIN(g_present[2] / NATIVE_WIDTH, 
+			g_present[3] / NATIVE_HEIGHT);
+	if (scale > 0) {
+		w = NATIVE_WIDTH * scale;
+		h = NATIVE_HEIGHT * scale;
+	} else {
+		w = g_present[2];
+		h = g_present[3];
+	}
+	x = g_present[0] + (g_present[2] - w) / 2;
+	y = g_present[1] + (g_present[3] - h) / 2;
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, g_target_fbo);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBlitFramebuffer(0, 0, NATIVE_WIDTH, NATIVE_HEIGHT, 
+			x, y, x + w, y + h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, g_target_fbo);
+}
+
+void init_gl(GLADloadproc load)
+{
+	init_prog_cache(load);
 	load_pallete();
+	glGenQueries(2 * TL_COUNT, *g_queries);
+	load_native();
 
-	load_tms(&g_tms, "res/shaders/tm.geom");
-	load_tms(&g_wms, "res/shaders/wm.geom");
-	g_tms.tex = load_tile_data("../Poke/Shared/Tiles/TileData00", 0);
-	g_wms.tex = load_tile_data("../Poke/Shared/Tiles/TileDataMenu", 2);
+	if (g_render_path == RP_COMP) {
+		load_comp();
+		return;
+	}
+
+	if (g_render_path == RP_QUAD) {
+		load_qms();
+	}
+
+	/*the window layer never scrolls, the map layer never culls*/
+	load_tms(&g_tms, "#define SCROLL\n");
+	load_tms(&g_wms, "#define CULL\n");
+	load_tile_data(&g_tms, "../Poke/Shared/Tiles/TileData00", 0);
+	load_tile_data(&g_wms, "../Poke/Shared/Tiles/TileDataMenu", 2);
+}
+
+void set_tile(struct tm_shader *tms, int x, int y, int t)
+{
+	y &= TILE_MAP_LEN - 1;
+	tms->tm[y][x & (TILE_MAP_LEN - 1)] = t;
+	tms->dirty |= 1U << y;
+}
+
+void mark_rows(struct tm_shader *tms, int y, int n)
+{
+	while (n-- > 0) {
+		tms->dirty |= 1U << (y++ & (TILE_MAP_LEN - 1));
+	}
+}
+
+static int pop_dirty(uint32_t *dirty, int *n)
+{
+	int y;
+
+	y = __builtin_ctz(*dirty);
+	*n = __builtin_ctzll(~(uint64_t) *dirty >> y);
+	*dirty &= ~(((1ULL << *n) - 1) << y);
+	return y;
+}
+
+static void upload_tm(struct tm_shader *tms)
+{
+	uint32_t dirty;
+
+	dirty = tms->dirty;
+	if (dirty == ~0U) {
+		/*orphan so the driver need not wait on the last draw*/
+		glBufferData(GL_ARRAY_BUFFER, sizeof(tms->tm), 
+				tms->tm, GL_DYNAMIC_DRAW);
+		g_upload_bytes += sizeof(tms->tm);
+	} else {
+		while (dirty) {
+			int y;
+			int n;
+
+			y = pop_dirty(&dirty, &n);
+			glBufferSubData(GL_ARRAY_BUFFER, y * sizeof(tile_row), 
+					n * sizeof(tile_row), tms->tm[y]);
+			g_upload_bytes += n * sizeof(tile_row);
+		}
+	}
+	tms->dirty = 0;
+}
+
+static void upload_ids(struct tm_shader *tms, int layer)
+{
+	uint32_t dirty;
+
+	dirty = tms->dirty;
+	while (dirty) {
+		int y;
+		int n;
+
+		y = pop_dirty(&dirty, &n);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, y, layer, 
+				TILE_MAP_LEN, n, 1, GL_RED_INTEGER, 
+				GL_UNSIGNED_BYTE, tms->tm[y]);
+		g_upload_bytes += n * sizeof(tile_row);
+	}
+	tms->dirty = 0;
 }
 
 static void render_tms(struct tm_shader *tms)
@@ -307,19 +815,156 @@ static void render_tms(struct tm_shader *tms)
 	glBindVertexArray(tms->vao);
 
 	glBindBuffer(GL_ARRAY_BUFFER, tms->vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(tms->tm), tms->tm);
+	upload_tm(tms);
 
 	glVertexAttribIPointer(0, 1, GL_UNSIGNED_BYTE, 1, NULL);
 	glEnableVertexAttribArray(0);
 
-        glDrawArrays(GL_POINTS, 0, sizeof(tms->tm));
+	if (g_render_path == RP_PULL) {
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_BUFFER, tms->tbo);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, 
+				VIEW_TILES_X * VIEW_TILES_Y);
+	} else {
+        	glDrawArrays(GL_POINTS, 0, sizeof(tms->tm));
+	}
+}
+
+static void render_comp(void)
+{
+	glUseProgram(g_cs.prog);
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, g_cs.ids);
+	upload_ids(&g_tms, 0);
+	upload_ids(&g_wms, 1);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_1D, g_pal);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, g_cs.tex);
+
+	glUniform2i(g_cs.tm_scroll_loc, g_tms.scroll.x, g_tms.scroll.y); 
+	glUniform2i(g_cs.wm_scroll_loc, g_wms.scroll.x, g_wms.scroll.y); 
+
+	glBindVertexArray(g_cs.vao);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void damage(void)
+{
+	g_damaged = 1;
+}
+
+static int tms_changed(const struct tm_shader *tms)
+{
+	return tms->dirty || 
+		tms->scroll.x != tms->drawn_scroll.x ||
+		tms->scroll.y != tms->drawn_scroll.y;
+}
+
+int is_damaged(void)
+{
+	return g_damaged || tms_changed(&g_tms) || tms_changed(&g_wms);
+}
+
+static void render_qms(void)
+{
+	glUseProgram(g_qms.prog);
+
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, g_qms.quads);
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, g_qms.qm);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_1D, g_pal);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, g_tms.tex);
+
+	glUniform2i(g_qms.cam_loc, g_qms.cam[0], g_qms.cam[1]);
+	glUniform2i(g_qms.size_loc, g_qms.size[0], g_qms.size[1]);
+	glUniform1ui(g_qms.def_loc, g_qms.def_quad);
+
+	glBindVertexArray(g_qms.vao);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+static void read_queries(int set)
+{
+	int i;
+
+	for (i = 0; i < TL_COUNT; i++) {
+		GLuint q;
+		GLint ready;
+		GLuint64 ns;
+
+		if (!g_query_live[set][i]) {
+			continue;
+		}
+
+		/*never wait on the GPU, a late result is simply dropped*/
+		q = g_queries[set][i];
+		glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &ready);
+		if (ready) {
+			glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+			g_gpu_time[i] = ns / 1e6;
+		}
+		g_query_live[set][i] = 0;
+	}
+}
+
+static void begin_timer(int layer)
+{
+	if (g_gpu_timing) {
+		glBeginQuery(GL_TIME_ELAPSED, g_queries[g_query_set][layer]);
+		g_query_live[g_query_set][layer] = 1;
+	}
+}
+
+static void end_timer(void)
+{
+	if (g_gpu_timing) {
+		glEndQuery(GL_TIME_ELAPSED);
+	}
 }
 
 void render(void)
 {
+	glBindFramebuffer(GL_FRAMEBUFFER, g_native_fbo);
+	glViewport(0, 0, NATIVE_WIDTH, NATIVE_HEIGHT);
 	glClearColor(0.2F, 0.3F, 0.3F, 1.0F);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	render_tms(&g_tms);
+	g_damaged = 0;
+	g_tms.drawn_scroll = g_tms.scroll;
+	g_wms.drawn_scroll = g_wms.scroll;
+
+	g_query_set ^= 1;
+	read_queries(g_query_set);
+
+	if (g_render_path == RP_COMP) {
+		/*both layers are a single pass here*/
+		begin_timer(TL_MAP);
+		render_comp();
+		end_timer();
+		present();
+		return;
+	}
+
+	begin_timer(TL_MAP);
+	if (g_qms.active) {
+		render_qms();
+	} else {
+		render_tms(&g_tms);
+	}
+	end_timer();
+
+	begin_timer(TL_WIN);
 	render_tms(&g_wms);
+	end_timer();
+	present();
 }
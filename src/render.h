@@ -4,37 +4,87 @@
 #include <cglm/cglm.h>
 #include <stdint.h>
 
-#define TILE_MAP_LEN 32 
+#include "tilemap.h"
 
-typedef uint8_t tile_row[TILE_MAP_LEN];
-typedef tile_row tile_map[TILE_MAP_LEN];
+#define VIEW_TILES_X 21
+#define VIEW_TILES_Y 19
 
-struct v2b {
-	uint8_t x;
-	uint8_t y;
+enum render_path {
+	RP_GEOM,
+	RP_PULL,
+	RP_COMP,
+	RP_QUAD
+};
+
+enum timed_layer {
+	TL_MAP,
+	TL_WIN,
+	TL_COUNT
 };
 
 struct tm_shader {
 	GLuint prog;
 	GLuint vao;
 	GLuint vbo;
+	GLuint tbo;
 
 	GLint proj_loc;
 	GLint tex_loc;
 	GLint pal_loc;
 	GLint scroll_loc;
+	GLint tiles_loc;
 
 	tile_map tm;
 	struct v2b scroll;
+	struct v2b drawn_scroll;
+	uint32_t dirty;
 
 	GLuint tex;
+	uint8_t *atlas;
+};
+
+struct qm_shader {
+	GLuint prog;
+	GLuint vao;
+
+	GLint cam_loc;
+	GLint size_loc;
+	GLint def_loc;
+
+	GLuint qm;
+	GLuint quads;
+
+	int active;
+	ivec2 cam;
+	ivec2 size;
+	int def_quad;
 };
 
 extern GLuint g_pal;
 extern struct tm_shader g_tms;
 extern struct tm_shader g_wms;
+extern struct qm_shader g_qms;
 
-void init_gl(void);
+/*since the last HUD sample, edits count as well as frames*/
+extern size_t g_upload_bytes;
+extern int g_render_path;
+extern int g_disk_shaders;
+extern int g_gpu_timing;
+extern double g_gpu_time[TL_COUNT];
+
+void init_gl(GLADloadproc load);
+void set_target_fbo(GLuint fbo);
+void set_present_rect(int x, int y, int w, int h);
 void render(void);
+void damage(void);
+int is_damaged(void);
+
+void set_tile(struct tm_shader *tms, int x, int y, int t);
+void mark_rows(struct tm_shader *tms, int y, int n);
+
+void qm_upload_rows(const uint8_t *data, int y, int n);
+void qm_set_cell(int x, int y, int d);
+void qm_upload_quads(const uint8_t *quad_data);
+void qm_set_quad_tile(int d, int i, int t);
 
 #endif
@@ -0,0 +1,12 @@
+#ifndef SHADERS_H
+#define SHADERS_H
+
+/*generated from res/shaders by the makefile, see obj/shaders.c*/
+struct shader_src {
+	const char *path;
+	const char *src;
+};
+
+extern const struct shader_src g_shader_srcs[];
+
+#endif
@@ -0,0 +1,139 @@
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "soft.h"
+
+#define MAP_PX (TILE_MAP_LEN * 8)
+
+/*
+ * A CPU model of what tm.vert, tm.geom and tm.frag draw at native 
+ * resolution: the map layer wraps and scrolls per pixel, the window 
+ * layer is fixed and its tile 0 is see-through. Atlas texels keep the
+ * shade in the top two bits, which is what the nearest palette lookup
+ * ends up using.
+ */
+static void put_tile_row(const uint8_t *atlas, int id, int ty, uint8_t *dst)
+{
+	memcpy(dst, atlas + ((id >> 4) * 8 + ty) * 128 + (id & 15) * 8, 8);
+}
+
+static void map_row(const struct tm_view *tms, int y, uint8_t *dst)
+{
+	uint8_t world[MAP_PX + NATIVE_WIDTH];
+	const uint8_t *row;
+	int wy;
+	int x;
+
+	wy = (y + tms->scroll.y) & (MAP_PX - 1);
+	row = tms->tm[wy >> 3];
+	for (x = 0; x < TILE_MAP_LEN; x++) {
+		put_tile_row(tms->atlas, row[x], wy & 7, world + x * 8);
+	}
+	memcpy(world + MAP_PX, world, NATIVE_WIDTH);
+	memcpy(dst, world + tms->scroll.x, NATIVE_WIDTH);
+}
+
+static void win_row(const struct tm_view *tms, int y, uint8_t *dst)
+{
+	const uint8_t *row;
+	int x;
+
+	row = tms->tm[y >> 3];
+	for (x = 0; x < NATIVE_WIDTH / 8; x++) {
+		if (row[x]) {
+			put_tile_row(tms->atlas, row[x], y & 7, dst + x * 8);
+		}
+	}
+}
+
+#ifdef __SSE2__
+static __m128i shade_px(__m128i s, const __m128i *pal)
+{
+	__m128i px;
+	int i;
+
+	px = _mm_setzero_si128();
+	for (i = 0; i < 4; i++) {
+		__m128i m;
+
+		m = _mm_cmpeq_epi32(s, _mm_set1_epi32(i));
+		px = _mm_or_si128(px, _mm_and_si128(m, pal[i]));
+	}
+	return px;
+}
+
+static void shade_row(const uint8_t *src, uint8_t *dst, const uint32_t *pal)
+{
+	__m128i p[4];
+	__m128i z;
+	__m128i three;
+	int i;
+	int x;
+
+	for (i = 0; i < 4; i++) {
+		p[i] = _mm_set1_epi32(pal[i]);
+	}
+	z = _mm_setzero_si128();
+	three = _mm_set1_epi8(3);
+
+	for (x = 0; x < NATIVE_WIDTH; x += 16) {
+		__m128i s;
+		__m128i lo;
+		__m128i hi;
+
+		s = _mm_loadu_si128((const __m128i *) (src + x));
+		s = _mm_and_si128(_mm_srli_epi16(s, 6), three);
+
+		lo = _mm_unpacklo_epi8(s, z);
+		hi = _mm_unpackhi_epi8(s, z);
+		_mm_storeu_si128((__m128i *) dst, 
+				shade_px(_mm_unpacklo_epi16(lo, z), p));
+		_mm_storeu_si128((__m128i *) (dst + 16), 
+				shade_px(_mm_unpackhi_epi16(lo, z), p));
+		_mm_storeu_si128((__m128i *) (dst + 32), 
+				shade_px(_mm_unpacklo_epi16(hi, z), p));
+		_mm_storeu_si128((__m128i *) (dst + 48), 
+				shade_px(_mm_unpackhi_epi16(hi, z), p));
+		dst += 64;
+	}
+}
+#else
+static void shade_row(const uint8_t *src, uint8_t *dst, const uint32_t *pal)
+{
+	int x;
+
+	for (x = 0; x < NATIVE_WIDTH; x++) {
+		memcpy(dst, &pal[src[x] >> 6], 4);
+		dst += 4;
+	}
+}
+#endif
+
+void soft_render(const struct tm_view *map, const struct tm_view *win, 
+		uint8_t *rgba)
+{
+	uint32_t pal[4];
+	uint8_t row[NATIVE_WIDTH];
+	int i;
+	int y;
+
+	for (i = 0; i < 4; i++) {
+		uint8_t c[4];
+
+		c[0] = g_pal_rgb[i][0];
+		c[1] = g_pal_rgb[i][1];
+		c[2] = g_pal_rgb[i][2];
+		c[3] = 0xFF;
+		memcpy(&pal[i], c, 4);
+	}
+
+	for (y = 0; y < NATIVE_HEIGHT; y++) {
+		map_row(map, y, row);
+		win_row(win, y, row);
+		shade_row(row, rgba, pal);
+		rgba += NATIVE_WIDTH * 4;
+	}
+}
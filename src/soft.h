@@ -0,0 +1,11 @@
+#ifndef SOFT_H
+#define SOFT_H
+
+#include <stdint.h>
+
+#include "tilemap.h"
+
+void soft_render(const struct tm_view *map, const struct tm_view *win, 
+		uint8_t *rgba);
+
+#endif
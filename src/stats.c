@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+void stat_push(struct stat_ring *r, float v)
+{
+	r->v[r->pos] = v;
+	r->pos = (r->pos + 1) % STAT_LEN;
+	if (r->n < STAT_LEN) {
+		r->n++;
+	}
+}
+
+static int cmp_float(const void *a, const void *b)
+{
+	float x;
+	float y;
+
+	x = *(const float *) a;
+	y = *(const float *) b;
+	return (x > y) - (x < y);
+}
+
+void stat_sum(const struct stat_ring *r, struct stat_summary *s)
+{
+	float v[STAT_LEN];
+	float sum;
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	if (r->n == 0) {
+		return;
+	}
+
+	memcpy(v, r->v, r->n * sizeof(*v));
+	qsort(v, r->n, sizeof(*v), cmp_float);
+
+	sum = 0.0F;
+	for (i = 0; i < r->n; i++) {
+		sum += v[i];
+	}
+
+	s->min = v[0];
+	s->avg = sum / r->n;
+	s->p99 = v[(r->n * 99 - 1) / 100];
+}
+
+void lat_add(struct lat_hist *h, double sec)
+{
+	double us;
+	int i;
+
+	us = sec * 1e6;
+	i = 0;
+	while (us >= 1.0 && i < LAT_BUCKETS - 1) {
+		us /= 2.0;
+		i++;
+	}
+
+	h->counts[i]++;
+	h->n++;
+	h->total += sec;
+	if (sec > h->max) {
+		h->max = sec;
+	}
+}
+
+void lat_print(const struct lat_hist *h, const char *name)
+{
+	int i;
+
+	if (h->n == 0) {
+		return;
+	}
+
+	printf("%s: %lu events, avg %.1f us, max %.1f us\n", name, h->n, 
+			h->total * 1e6 / h->n, h->max * 1e6);
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		char range[32];
+
+		if (h->counts[i] == 0) {
+			continue;
+		}
+		if (i == 0) {
+			strcpy(range, "<1 us");
+		} else {
+			snprintf(range, sizeof(range), "%lu-%lu us", 
+					1UL << (i - 1), 1UL << i);
+		}
+		printf("  %16s: %lu\n", range, h->counts[i]);
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef STATS_H
+#define STATS_H
+
+#define STAT_LEN 128
+
+/*rolling window of the last STAT_LEN samples*/
+struct stat_ring {
+	float v[STAT_LEN];
+	int n;
+	int pos;
+};
+
+struct stat_summary {
+	float min;
+	float avg;
+	float p99;
+};
+
+#define LAT_BUCKETS 24
+
+/*bucket 0 is under 1 us, bucket i covers [2^(i-1), 2^i) us*/
+struct lat_hist {
+	unsigned long counts[LAT_BUCKETS];
+	unsigned long n;
+	double total;
+	double max;
+};
+
+void stat_push(struct stat_ring *r, float v);
+void stat_sum(const struct stat_ring *r, struct stat_summary *s);
+
+void lat_add(struct lat_hist *h, double sec);
+void lat_print(const struct lat_hist *h, const char *name);
+
+#endif
@@ -0,0 +1,136 @@
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tile.h"
+
+#define PX(c, s) ((((c) >> (s)) & 3) << 6)
+#define E1(c) {PX(c, 6), PX(c, 4), PX(c, 2), PX(c, 0)}
+#define E4(c) E1(c), E1(c + 1), E1(c + 2), E1(c + 3)
+#define E16(c) E4(c), E4(c + 4), E4(c + 8), E4(c + 12)
+#define E64(c) E16(c), E16(c + 16), E16(c + 32), E16(c + 48)
+
+static const uint8_t g_px_lut[256][4] = {
+	E64(0), E64(64), E64(128), E64(192)
+};
+
+void decomp_tile_lut(const uint8_t *src, uint8_t *dst, int stride)
+{
+	int i;
+
+	i = 8;
+	while (i-- > 0) {
+		memcpy(dst, g_px_lut[src[0]], 4);
+		memcpy(dst + 4, g_px_lut[src[1]], 4);
+		src += 2;
+		dst += stride;
+	}
+}
+
+#ifdef __SSE2__
+void decomp_tile(const uint8_t *src, uint8_t *dst, int stride)
+{
+	__m128i m;
+	__m128i x;
+	__m128i p0, p1, p2, p3;
+	__m128i lo, hi;
+	__m128i r[4];
+	int i;
+
+	/*each pixel is two bits, move it to the top and mask*/
+	m = _mm_set1_epi8((char) 0xC0);
+	x = _mm_loadu_si128((const __m128i *) src);
+	p0 = _mm_and_si128(x, m);
+	p1 = _mm_and_si128(_mm_slli_epi16(x, 2), m);
+	p2 = _mm_and_si128(_mm_slli_epi16(x, 4), m);
+	p3 = _mm_and_si128(_mm_slli_epi16(x, 6), m);
+
+	lo = _mm_unpacklo_epi8(p0, p1);
+	hi = _mm_unpacklo_epi8(p2, p3);
+	r[0] = _mm_unpacklo_epi16(lo, hi);
+	r[1] = _mm_unpackhi_epi16(lo, hi);
+
+	lo = _mm_unpackhi_epi8(p0, p1);
+	hi = _mm_unpackhi_epi8(p2, p3);
+	r[2] = _mm_unpacklo_epi16(lo, hi);
+	r[3] = _mm_unpackhi_epi16(lo, hi);
+
+	for (i = 0; i < 4; i++) {
+		_mm_storel_epi64((__m128i *) dst, r[i]);
+		dst += stride;
+		_mm_storel_epi64((__m128i *) dst, _mm_srli_si128(r[i], 8));
+		dst += stride;
+	}
+}
+#else
+void decomp_tile(const uint8_t *src, uint8_t *dst, int stride)
+{
+	decomp_tile_lut(src, dst, stride);
+}
+#endif
+
+void expand_quads_ref(const uint8_t *quads, const uint8_t *ids, 
+		int n, uint8_t *top, uint8_t *bot)
+{
+	while (n-- > 0) {
+		const uint8_t *q;
+
+		q = quads + *ids++ * 4;
+		memcpy(top, q, 2);
+		memcpy(bot, q + 2, 2);
+		top += 2;
+		bot += 2;
+	}
+}
+
+#ifdef __SSE2__
+static int load_quad(const uint8_t *quads, int id)
+{
+	int32_t q;
+
+	memcpy(&q, quads + id * 4, 4);
+	return q;
+}
+
+static __m128i load_quads(const uint8_t *quads, const uint8_t *ids)
+{
+	/*lane by lane, a wide reload of scalar stores would stall*/
+	return _mm_setr_epi32(load_quad(quads, ids[0]), 
+			load_quad(quads, ids[1]), load_quad(quads, ids[2]), 
+			load_quad(quads, ids[3]));
+}
+
+static __m128i split_rows(__m128i x)
+{
+	/*words t0 b0 t1 b1 t2 b2 t3 b3 become t0 t1 t2 t3 b0 b1 b2 b3*/
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 1, 2, 0));
+	x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+void expand_quads(const uint8_t *quads, const uint8_t *ids, 
+		int n, uint8_t *top, uint8_t *bot)
+{
+	while (n >= 8) {
+		__m128i lo, hi;
+
+		lo = split_rows(load_quads(quads, ids));
+		hi = split_rows(load_quads(quads, ids + 4));
+		_mm_storeu_si128((__m128i *) top, _mm_unpacklo_epi64(lo, hi));
+		_mm_storeu_si128((__m128i *) bot, _mm_unpackhi_epi64(lo, hi));
+		ids += 8;
+		top += 16;
+		bot += 16;
+		n -= 8;
+	}
+	expand_quads_ref(quads, ids, n, top, bot);
+}
+#else
+void expand_quads(const uint8_t *quads, const uint8_t *ids, 
+		int n, uint8_t *top, uint8_t *bot)
+{
+	expand_quads_ref(quads, ids, n, top, bot);
+}
+#endif
@@ -0,0 +1,17 @@
+#ifndef TILE_H
+#define TILE_H
+
+#include <stdint.h>
+
+#define TILE_BYTES 16
+
+void decomp_tile_lut(const uint8_t *src, uint8_t *dst, int stride);
+void decomp_tile(const uint8_t *src, uint8_t *dst, int stride);
+
+/*quads holds 4 tiles per quad id, the top row first*/
+void expand_quads_ref(const uint8_t *quads, const uint8_t *ids, 
+		int n, uint8_t *top, uint8_t *bot);
+void expand_quads(const uint8_t *quads, const uint8_t *ids, 
+		int n, uint8_t *top, uint8_t *bot);
+
+#endif
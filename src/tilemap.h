@@ -0,0 +1,29 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include <stdint.h>
+
+/*shared by the GL renderer and its CPU model, so no GL types here*/
+#define TILE_MAP_LEN 32 
+
+#define NATIVE_WIDTH 160
+#define NATIVE_HEIGHT 144
+
+typedef uint8_t tile_row[TILE_MAP_LEN];
+typedef tile_row tile_map[TILE_MAP_LEN];
+
+struct v2b {
+	uint8_t x;
+	uint8_t y;
+};
+
+/*the parts of a tile map layer that decide its pixels*/
+struct tm_view {
+	const tile_row *tm;
+	struct v2b scroll;
+	const uint8_t *atlas;
+};
+
+extern const uint8_t g_pal_rgb[4][3];
+
+#endif
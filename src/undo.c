@@ -0,0 +1,136 @@
+#include <stdio.h>
+
+#include "undo.h"
+#include "xstd.h"
+
+static struct undo_rec *g_recs;
+static size_t g_cap;
+
+/*absolute record counts, index with % g_cap*/
+static size_t g_beg;
+static size_t g_cur;
+static size_t g_end;
+
+static int g_join;
+
+/*where the step being pushed began, and whether it outgrew the ring*/
+static size_t g_step;
+static int g_overflow;
+
+void undo_init(size_t budget)
+{
+	g_cap = budget / sizeof(*g_recs);
+	if (g_cap == 0) {
+		g_cap = 1;
+	}
+	g_recs = xmalloc(g_cap * sizeof(*g_recs));
+	undo_clear();
+}
+
+void undo_clear(void)
+{
+	g_beg = 0;
+	g_cur = 0;
+	g_end = 0;
+	g_join = 0;
+	g_step = 0;
+	g_overflow = 0;
+}
+
+void undo_begin(void)
+{
+	g_join = 0;
+	g_overflow = 0;
+}
+
+static struct undo_rec *rec_at(size_t i)
+{
+	return g_recs + i % g_cap;
+}
+
+static void evict_oldest(void)
+{
+	/*never leave half of a step behind*/
+	do {
+		g_beg++;
+	} while (g_beg < g_end && (rec_at(g_beg)->flags & UF_JOIN));
+}
+
+void undo_push(int kind, int x, int y, int idx, int old, int new)
+{
+	struct undo_rec *r;
+
+	if (g_overflow) {
+		return;
+	}
+
+	g_end = g_cur;
+	if (!g_join) {
+		g_step = g_end;
+	}
+	if (g_end - g_beg >= g_cap) {
+		/*a step that fills the ring alone can only be dropped whole*/
+		if (g_beg == g_step) {
+			fprintf(stderr, "undo: step too large, not undoable\n");
+			g_end = g_step;
+			g_cur = g_step;
+			g_overflow = 1;
+			return;
+		}
+		evict_oldest();
+	}
+
+	r = rec_at(g_end);
+	r->kind = kind;
+	r->flags = g_join ? UF_JOIN : 0;
+	r->x = x;
+	r->y = y;
+	r->idx = idx;
+	r->old = old;
+	r->new = new;
+
+	g_end++;
+	g_cur = g_end;
+	g_join = 1;
+}
+
+int undo_coalesce(int kind, int x, int y, int idx, int new)
+{
+	struct undo_rec *r;
+
+	if (g_cur == g_beg || g_cur != g_end) {
+		return 0;
+	}
+
+	r = rec_at(g_cur - 1);
+	if (r->kind != kind || r->x != x || r->y != y || r->idx != idx) {
+		return 0;
+	}
+
+	r->new = new;
+	return 1;
+}
+
+const struct undo_rec *undo_pop(void)
+{
+	if (g_cur == g_beg) {
+		return NULL;
+	}
+	return rec_at(--g_cur);
+}
+
+const struct undo_rec *redo_pop(void)
+{
+	if (g_cur == g_end) {
+		return NULL;
+	}
+	return rec_at(g_cur++);
+}
+
+const struct undo_rec *redo_peek(void)
+{
+	if (g_cur == g_end) {
+		return NULL;
+	}
+	return rec_at(g_cur);
+}
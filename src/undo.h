@@ -0,0 +1,48 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UF_JOIN 1
+
+enum undo_kind {
+	UK_QUAD,
+	UK_TILE,
+	UK_PROP,
+	UK_INS,
+	UK_DEL,
+	UK_FREE,
+	UK_OBJ,
+	UK_OSET
+};
+
+/*
+ * UK_QUAD: quad map cell (x, y)
+ * UK_TILE: tile idx of quad x
+ * UK_PROP: props of quad x
+ * UK_INS/UK_DEL: char at offset idx of the text at (x, y)
+ * UK_FREE: the (by then empty) text at (x, y) was destroyed 
+ * UK_OBJ: whether an empty object at (x, y) sits at index idx
+ * UK_OSET: field y of object x, char idx for OF_STR
+ */
+struct undo_rec {
+	uint8_t kind;
+	uint8_t flags;
+	uint8_t x;
+	uint8_t y;
+	uint8_t idx;
+	uint8_t old;
+	uint8_t new;
+};
+
+void undo_init(size_t budget);
+void undo_clear(void);
+void undo_begin(void);
+void undo_push(int kind, int x, int y, int idx, int old, int new);
+int undo_coalesce(int kind, int x, int y, int idx, int new);
+const struct undo_rec *undo_pop(void);
+const struct undo_rec *redo_pop(void);
+const struct undo_rec *redo_peek(void);
+
+#endif
@@ -1,10 +1,24 @@
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #include "xstd.h"
 
+int g_trace_on;
+
+static struct trace_ev *g_trace;
+static int g_trace_cap;
+static int g_trace_len;
+static int g_trace_dropped;
+static double g_trace_base;
+
 static void crt_print(const char *msg)
 {
 	fprintf(stderr, "crt error: %s: %s (%d)\n", 
@@ -18,7 +32,7 @@ static void crt_printf(const char *fmt, ...)
 	char msg[1024];
 
 	va_start(ap, fmt);
-	vsprintf_s(msg, sizeof(msg), fmt, ap);
+	vsnprintf(msg, sizeof(msg), fmt, ap);
 	va_end(ap);
 	crt_print(msg);
 }
@@ -111,3 +125,183 @@ long get_file_size(FILE *f)
 	xfseek(f, 0, SEEK_SET);
 	return pos;
 }
+
+int span_read_file(struct span *s, const char *path)
+{
+	FILE *f;
+	long len;
+
+	s->data = NULL;
+	s->len = 0;
+	s->pos = 0;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		return -1;
+	}
+
+	len = get_file_size(f);
+	s->data = xmalloc(len);
+	if (fread(s->data, 1, len, f) != (size_t) len) {
+		fclose(f);
+		span_free(s);
+		return -1;
+	}
+	s->len = len;
+
+	fclose(f);
+	return 0;
+}
+
+void span_free(struct span *s)
+{
+	free(s->data);
+	s->data = NULL;
+	s->len = 0;
+	s->pos = 0;
+}
+
+size_t span_left(const struct span *s)
+{
+	return s->len - s->pos;
+}
+
+int span_getc(struct span *s)
+{
+	if (s->pos >= s->len) {
+		return -1;
+	}
+	return s->data[s->pos++];
+}
+
+int span_read(struct span *s, void *buf, size_t size)
+{
+	if (span_left(s) < size) {
+		return -1;
+	}
+	memcpy(buf, s->data + s->pos, size);
+	s->pos += size;
+	return 0;
+}
+
+int span_skip(struct span *s, size_t size)
+{
+	if (span_left(s) < size) {
+		return -1;
+	}
+	s->pos += size;
+	return 0;
+}
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t h)
+{
+	const uint8_t *b;
+
+	/*FNV-1a*/
+	b = data;
+	while (size-- > 0) {
+		h ^= *b++;
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+double get_time(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (!freq.QuadPart) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&now);
+	return (double) now.QuadPart / freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void sleep_time(double sec)
+{
+#ifdef _WIN32
+	Sleep((DWORD) (sec * 1000.0));
+#else
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) sec;
+	ts.tv_nsec = (long) ((sec - ts.tv_sec) * 1e9);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+void trace_init(int cap)
+{
+	g_trace = xrealloc(g_trace, cap * sizeof(*g_trace));
+	g_trace_cap = cap;
+	g_trace_len = 0;
+	g_trace_dropped = 0;
+	g_trace_base = get_time();
+	g_trace_on = 1;
+}
+
+int trace_begin(const char *name)
+{
+	struct trace_ev *ev;
+
+	if (g_trace_len == g_trace_cap) {
+		g_trace_dropped++;
+		return -1;
+	}
+
+	ev = &g_trace[g_trace_len];
+	ev->name = name;
+	ev->end = 0.0;
+	ev->beg = get_time();
+	return g_trace_len++;
+}
+
+void trace_end(int id)
+{
+	g_trace[id].end = get_time();
+}
+
+int trace_write(const char *path)
+{
+	FILE *f;
+	double now;
+	int i;
+
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "trace: cannot write \"%s\"\n", path);
+		return -1;
+	}
+
+	/*spans still open are cut off at the time of the write*/
+	now = get_time();
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (i = 0; i < g_trace_len; i++) {
+		const struct trace_ev *ev;
+		double end;
+
+		ev = &g_trace[i];
+		end = ev->end > 0.0 ? ev->end : now;
+		fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+				"\"ts\":%.3f,\"dur\":%.3f}%s\n", ev->name, 
+				(ev->beg - g_trace_base) * 1e6, 
+				(end - ev->beg) * 1e6,
+				i + 1 < g_trace_len ? "," : "");
+	}
+	fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(f);
+
+	if (g_trace_dropped > 0) {
+		fprintf(stderr, "trace: %d spans dropped, buffer full\n", 
+				g_trace_dropped);
+	}
+	return 0;
+}
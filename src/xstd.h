@@ -1,8 +1,23 @@
 #ifndef XSTD_H
 #define XSTD_H
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#ifndef _countof
+#define _countof(a) (sizeof(a) / sizeof(*(a)))
+#endif
+
+struct span {
+	uint8_t *data;
+	size_t len;
+	size_t pos;
+};
+
 void *xmalloc(size_t size);
 void *xrealloc(void *ptr, size_t size);
 
@@ -16,4 +31,35 @@ long xftell(FILE *f);
 
 long get_file_size(FILE *f);
 
+int span_read_file(struct span *s, const char *path);
+void span_free(struct span *s);
+size_t span_left(const struct span *s);
+int span_getc(struct span *s);
+int span_read(struct span *s, void *buf, size_t size);
+int span_skip(struct span *s, size_t size);
+
+#define HASH_SEED 0xCBF29CE484222325ULL
+
+uint64_t hash_bytes(const void *data, size_t size, uint64_t h);
+
+double get_time(void);
+void sleep_time(double sec);
+
+/*names must be string literals, they are stored and written unescaped*/
+struct trace_ev {
+	const char *name;
+	double beg;
+	double end;
+};
+
+extern int g_trace_on;
+
+#define TRACE_BEGIN(name) (g_trace_on ? trace_begin(name) : -1)
+#define TRACE_END(id) ((id) >= 0 ? trace_end(id) : (void) 0)
+
+void trace_init(int cap);
+int trace_begin(const char *name);
+void trace_end(int id);
+int trace_write(const char *path);
+
 #endif